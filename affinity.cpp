@@ -0,0 +1,164 @@
+#include "affinity.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <set>
+
+#include "exception.hpp"
+#include "utils.hpp"
+
+// parses kernel style CPU list: "0-3,8,10-11"
+static std::vector<int> parse_cpu_list(std::string const& list)
+{
+    std::vector<int> cpus;
+
+    for(std::string const& item : split(list, ','))
+    {
+        if (item.empty())
+            continue;
+
+        try {
+            size_t dash = item.find('-');
+            int from = std::stoi(item.substr(0, dash));
+            int to   = (dash == std::string::npos) ? from : std::stoi(item.substr(dash + 1));
+
+            if (from < 0 || to < from || to >= CPU_SETSIZE)
+                throw std::invalid_argument(item);
+
+            for(int cpu = from; cpu <= to; cpu++)
+                cpus.push_back(cpu);
+        } catch (...) {
+            throw Exception("Incorrect CPU list <" + list + ">");
+        }
+    }
+
+    return cpus;
+}
+
+std::vector<int> placement_t::cpus_for(size_t index) const
+{
+    if (cpus.empty() || !spread)
+        return cpus;
+
+    return std::vector<int>(1, cpus[index % cpus.size()]);
+}
+
+placement_t placement_t::parse(std::string const& spec)
+{
+    placement_t p;
+    if (spec.empty())
+        return p;
+
+    if (spec.compare(0, 5, "node:") == 0)
+    {
+        std::string path = "/sys/devices/system/node/node" + spec.substr(5) + "/cpulist";
+        std::ifstream f(path.c_str());
+        std::string list;
+        if (!f || !std::getline(f, list))
+            throw Exception("Unknown NUMA node <" + spec + ">");
+
+        p.cpus   = parse_cpu_list(list);
+        p.spread = false;
+    } else
+        p.cpus = parse_cpu_list(spec);
+
+    if (p.cpus.empty())
+        throw Exception("No CPUs in <" + spec + ">");
+
+    return p;
+}
+
+void pin_current_thread(std::vector<int> const& cpus)
+{
+    if (cpus.empty())
+        return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu : cpus)
+        CPU_SET(cpu, &set);
+
+    int s = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (s != 0)
+        throw Exception("Failed to pin thread to CPUs " + describe_cpus(cpus) + ": " + strerror(s));
+}
+
+std::vector<int> current_thread_cpus()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        return std::vector<int>();
+
+    std::vector<int> cpus;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+
+    return cpus;
+}
+
+int numa_node_of_cpu(int cpu)
+{
+    // CPU directory has "nodeN" link to its node
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return -1;
+
+    int node = -1;
+    while (struct dirent *e = readdir(dir))
+        if (strncmp(e->d_name, "node", 4) == 0 && isdigit((unsigned char)e->d_name[4]))
+        {
+            node = atoi(e->d_name + 4);
+            break;
+        }
+
+    closedir(dir);
+    return node;
+}
+
+std::string describe_cpus(std::vector<int> const& cpus)
+{
+    if (cpus.empty())
+        return "any";
+
+    std::vector<int> sorted(cpus);
+    std::sort(sorted.begin(), sorted.end());
+
+    std::string r;
+    std::set<int> nodes;
+    for(size_t i = 0; i < sorted.size(); )
+    {
+        size_t j = i;
+        while (j + 1 < sorted.size() && sorted[j + 1] == sorted[j] + 1)
+            j++;
+
+        if (!r.empty())
+            r += ",";
+        r += std::to_string(sorted[i]);
+        if (j > i)
+            r += "-" + std::to_string(sorted[j]);
+
+        for(size_t k = i; k <= j; k++)
+            nodes.insert(numa_node_of_cpu(sorted[k]));
+        i = j + 1;
+    }
+
+    r += "(";
+    bool first = true;
+    for(int n : nodes)
+    {
+        r += (first ? "node" : ",node") + (n < 0 ? std::string("?") : std::to_string(n));
+        first = false;
+    }
+    r += ")";
+
+    return r;
+}
@@ -0,0 +1,37 @@
+#ifndef AFFINITY_HPP
+#define AFFINITY_HPP
+
+#include <string>
+#include <vector>
+
+// Placement of group of threads on CPUs.
+//  Spec is either list of cores "0-3,8" (thread i runs on cores[i % count])
+//  or NUMA node "node:1" (every thread may run on any core of the node).
+struct placement_t {
+    std::vector<int> cpus;
+    bool             spread;    // one core per thread
+
+    placement_t(): spread(true) {}
+
+    bool empty() const { return cpus.empty(); }
+
+    // CPUs for i-th thread of the group (empty - no pinning)
+    std::vector<int> cpus_for(size_t index) const;
+
+    static placement_t parse(std::string const& spec);
+};
+
+// pins calling thread to given CPUs (does nothing if list is empty)
+//  throws on failure
+void pin_current_thread(std::vector<int> const& cpus);
+
+// CPUs calling thread is allowed to run on
+std::vector<int> current_thread_cpus();
+
+// NUMA node of CPU (-1 if unknown)
+int numa_node_of_cpu(int cpu);
+
+// "2-3(node0)" or "any" for empty list
+std::string describe_cpus(std::vector<int> const& cpus);
+
+#endif //AFFINITY_HPP
@@ -0,0 +1,282 @@
+#include "balancer.hpp"
+
+#include <strings.h>
+#include <cmath>
+#include <chrono>
+
+#include "exception.hpp"
+#include "logger.hpp"
+
+// weight of new sample in EWMA
+static const double EWMA_ALPHA = 0.2;
+// EWMA of node which is not used decays with this time constant, so
+//  slow node gets probe requests again after a while
+static const double EWMA_DECAY_US = 1000000.0;
+
+static uint64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// cheap per-thread random numbers
+static uint32_t fast_rand()
+{
+    static thread_local uint32_t state = uint32_t(now_us()) | 1;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+balancer_t::balancer_t(policy_e policy, std::vector<std::string> const& addrs)
+    : m_policy(policy)
+    , m_next(0)
+{
+    for(std::string const& addr : addrs)
+    {
+        std::unique_ptr<node_state_t> n(new node_state_t);
+        n->addr = addr;
+        m_nodes.push_back(std::move(n));
+    }
+}
+
+balancer_t::policy_e balancer_t::policy_by_name(std::string const& name)
+{
+    for(policy_e p : { policy_e::FIRST, policy_e::ROUND_ROBIN,
+                       policy_e::LEAST_OUTSTANDING, policy_e::EWMA_P2C })
+        if (strcasecmp(name.c_str(), policy_name(p)) == 0)
+            return p;
+
+    throw Exception("Unknown balancing policy <" + name + ">");
+}
+
+const char* balancer_t::breaker_name(node_state_t::breaker_e state)
+{
+    switch(state)
+    {
+    case node_state_t::breaker_e::CLOSED:    return "closed";
+    case node_state_t::breaker_e::OPEN:      return "open";
+    case node_state_t::breaker_e::HALF_OPEN: return "half-open";
+    }
+    return "unknown";
+}
+
+const char* balancer_t::policy_name(policy_e policy)
+{
+    switch(policy)
+    {
+    case policy_e::FIRST:             return "first";
+    case policy_e::ROUND_ROBIN:       return "round-robin";
+    case policy_e::LEAST_OUTSTANDING: return "least-outstanding";
+    case policy_e::EWMA_P2C:          return "ewma";
+    }
+    return "unknown";
+}
+
+int balancer_t::pick(std::vector<riak_iface_ptr> const& conns, int exclude)
+{
+    return pick_if(conns.size(), [&conns] (size_t i) { return bool(conns[i]); }, exclude);
+}
+
+int balancer_t::pick(std::vector<char> const& avail, int exclude)
+{
+    return pick_if(avail.size(), [&avail] (size_t i) { return avail[i] != 0; }, exclude);
+}
+
+template<class F>
+int balancer_t::pick_if(size_t n, F const& has_conn, int exclude)
+{
+    int result = -1;
+
+    uint64_t now = m_breaker.enabled() ? now_us() : 0;
+    auto usable = [this, &has_conn, exclude, now] (size_t i) {
+        return has_conn(i) && int(i) != exclude && (!m_breaker.enabled() || admits(i, now)); };
+
+    switch(m_policy)
+    {
+    case policy_e::FIRST:
+        for(size_t i = 0; i < n && result < 0; i++)
+            if (usable(i))
+                result = i;
+        break;
+
+    case policy_e::ROUND_ROBIN:
+    {
+        // turn goes over available nodes only, so neighbour of
+        //  unavailable node does not get its share
+        static thread_local std::vector<size_t> avail;
+        avail.clear();
+        for(size_t i = 0; i < n; i++)
+            if (usable(i))
+                avail.push_back(i);
+
+        if (!avail.empty())
+            result = avail[m_next.fetch_add(1, std::memory_order_relaxed) % avail.size()];
+        break;
+    }
+
+    case policy_e::LEAST_OUTSTANDING:
+    {
+        // scan starts from different nodes so ties are spread evenly
+        size_t start = m_next.fetch_add(1, std::memory_order_relaxed);
+        size_t best = 0;
+        for(size_t i = 0; i < n; i++)
+        {
+            size_t k = (start + i) % n;
+            if (!usable(k))
+                continue;
+
+            size_t load = m_nodes[k]->outstanding.load(std::memory_order_relaxed);
+            if (result < 0 || load < best)
+            {
+                result = k;
+                best = load;
+            }
+        }
+        break;
+    }
+
+    case policy_e::EWMA_P2C:
+    {
+        // two random distinct nodes, the one with lower score wins
+        static thread_local std::vector<size_t> avail;
+        avail.clear();
+        for(size_t i = 0; i < n; i++)
+            if (usable(i))
+                avail.push_back(i);
+
+        size_t count = avail.size();
+
+        if (count == 0)
+            break;
+        if (count == 1)
+        {
+            result = avail[0];
+            break;
+        }
+
+        size_t a = fast_rand() % count;
+        size_t b = fast_rand() % (count - 1);
+        if (b >= a)
+            b++;
+
+        uint64_t t = now ? now : now_us();
+        result = score(avail[a], t) <= score(avail[b], t) ? avail[a] : avail[b];
+        break;
+    }
+    }
+
+    if (result >= 0)
+    {
+        m_nodes[result]->selected.fetch_add(1, std::memory_order_relaxed);
+        if (m_breaker.enabled())
+            on_probe(result, now);
+    }
+
+    return result;
+}
+
+void balancer_t::on_start(int node)
+{
+    m_nodes[node]->outstanding.fetch_add(1, std::memory_order_relaxed);
+}
+
+void balancer_t::on_done(int node, uint64_t latency_us, bool ok)
+{
+    node_state_t& n = *m_nodes[node];
+
+    n.outstanding.fetch_sub(1, std::memory_order_relaxed);
+    if (!ok)
+        n.failures.fetch_add(1, std::memory_order_relaxed);
+
+    if (m_breaker.enabled())
+        update_breaker(n, ok);
+
+    double cur = n.ewma_us.load(std::memory_order_relaxed);
+    double next;
+    do {
+        next = (cur == 0) ? latency_us : cur + EWMA_ALPHA * (latency_us - cur);
+    } while (!n.ewma_us.compare_exchange_weak(cur, next, std::memory_order_relaxed));
+
+    n.ewma_updated_us.store(now_us(), std::memory_order_relaxed);
+}
+
+// expected cost of sending request to node: latency scaled by queue on it
+double balancer_t::score(size_t node, uint64_t now) const
+{
+    node_state_t const& n = *m_nodes[node];
+
+    double ewma = n.ewma_us.load(std::memory_order_relaxed);
+    uint64_t updated = n.ewma_updated_us.load(std::memory_order_relaxed);
+    if (now > updated)
+        ewma *= exp(-double(now - updated) / EWMA_DECAY_US);
+
+    return ewma * (n.outstanding.load(std::memory_order_relaxed) + 1);
+}
+
+bool balancer_t::admits(size_t node, uint64_t now) const
+{
+    node_state_t const& n = *m_nodes[node];
+
+    switch(n.breaker.load(std::memory_order_relaxed))
+    {
+    case node_state_t::breaker_e::CLOSED:
+        return true;
+    case node_state_t::breaker_e::OPEN:
+        return now >= n.opened_us.load(std::memory_order_relaxed) + uint64_t(m_breaker.open_ms * 1000);
+    case node_state_t::breaker_e::HALF_OPEN:
+        return n.probes_sent.load(std::memory_order_relaxed) < m_breaker.probes;
+    }
+    return false;
+}
+
+void balancer_t::on_probe(size_t node, uint64_t now)
+{
+    node_state_t& n = *m_nodes[node];
+
+    // the first request after open time starts probing
+    node_state_t::breaker_e state = n.breaker.load();
+    if (state == node_state_t::breaker_e::OPEN
+        && n.breaker.compare_exchange_strong(state, node_state_t::breaker_e::HALF_OPEN))
+    {
+        n.probes_ok.store(0);
+        n.probes_sent.store(0);
+        state = node_state_t::breaker_e::HALF_OPEN;
+    }
+
+    // concurrent pickers may send a bit more probes than allowed
+    if (state == node_state_t::breaker_e::HALF_OPEN)
+        n.probes_sent.fetch_add(1);
+}
+
+void balancer_t::update_breaker(node_state_t& n, bool ok)
+{
+    node_state_t::breaker_e state = n.breaker.load();
+
+    if (ok)
+    {
+        n.consecutive_failures.store(0, std::memory_order_relaxed);
+
+        // enough probes answered: node is back
+        if (state == node_state_t::breaker_e::HALF_OPEN
+            && n.probes_ok.fetch_add(1) + 1 >= m_breaker.probes
+            && n.breaker.compare_exchange_strong(state, node_state_t::breaker_e::CLOSED))
+            LOG << "Circuit breaker of node " << n.addr << " is closed" << endl;
+        return;
+    }
+
+    // failed probe opens breaker again
+    unsigned failures = n.consecutive_failures.fetch_add(1) + 1;
+    if ((state == node_state_t::breaker_e::CLOSED && failures >= m_breaker.failures)
+        || state == node_state_t::breaker_e::HALF_OPEN)
+    {
+        if (!n.breaker.compare_exchange_strong(state, node_state_t::breaker_e::OPEN))
+            return;
+
+        n.opened_us.store(now_us());
+        n.breaker_opened.fetch_add(1, std::memory_order_relaxed);
+        LOG_W << "Circuit breaker of node " << n.addr << " is open (" << failures
+              << " failures)" << endl;
+    }
+}
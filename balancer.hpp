@@ -0,0 +1,112 @@
+#ifndef BALANCER_HPP
+#define BALANCER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "riak_iface.hpp"
+
+// State of one Riak node shared by all executor threads
+struct node_state_t {
+    std::string            addr;
+
+    std::atomic<size_t>    outstanding;     // requests being executed now
+    std::atomic<uint64_t>  selected;        // times node was picked
+    std::atomic<uint64_t>  failures;
+
+    // exponentially weighted moving average of latency, us
+    std::atomic<double>    ewma_us;
+    std::atomic<uint64_t>  ewma_updated_us; // time of the last sample
+
+    // circuit breaker (see breaker_opts_t)
+    enum class breaker_e {
+        CLOSED = 0,         // requests go to node
+        OPEN,               // node gets nothing until open time passes
+        HALF_OPEN,          // only probes go to node
+    };
+    std::atomic<breaker_e> breaker;
+    std::atomic<unsigned>  consecutive_failures;
+    std::atomic<uint64_t>  opened_us;       // when breaker was opened
+    std::atomic<unsigned>  probes_sent;     // since breaker became half-open
+    std::atomic<unsigned>  probes_ok;
+    std::atomic<uint64_t>  breaker_opened;  // times breaker was opened
+
+    node_state_t(): outstanding(0), selected(0), failures(0), ewma_us(0), ewma_updated_us(0),
+                    breaker(breaker_e::CLOSED), consecutive_failures(0), opened_us(0),
+                    probes_sent(0), probes_ok(0), breaker_opened(0) {}
+};
+
+// per-node circuit breaker: node which keeps failing gets no requests
+//  for a while, then a few probe requests decide if it is back
+struct breaker_opts_t {
+    // consecutive failures which open breaker (0 - breakers are disabled)
+    unsigned failures;
+    // time breaker stays open before probes are sent, ms
+    double   open_ms;
+    // probes in flight at once, and successful ones which close breaker
+    unsigned probes;
+
+    breaker_opts_t(): failures(0), open_ms(1000), probes(3) {}
+
+    bool enabled() const { return failures > 0; }
+};
+
+// Picks node (connection) for the next request
+class balancer_t {
+public:
+    enum class policy_e {
+        FIRST = 0,          // the first available node (fail-over only)
+        ROUND_ROBIN,
+        LEAST_OUTSTANDING,
+        EWMA_P2C,           // power of two random choices by EWMA latency and load
+    };
+
+    balancer_t(policy_e policy, std::vector<std::string> const& addrs);
+
+    // picks one of nodes which have connection in 'conns' (index is node number)
+    //  except 'exclude' node and nodes with open breaker, returns -1
+    //  if there is no such node
+    int pick(std::vector<riak_iface_ptr> const& conns, int exclude = -1);
+    // the same for nodes which have non-zero flag in 'avail'
+    int pick(std::vector<char> const& avail, int exclude = -1);
+
+    // must be set before requests are sent
+    void set_breaker(breaker_opts_t const& opts) { m_breaker = opts; }
+    breaker_opts_t const& breaker() const { return m_breaker; }
+    static const char* breaker_name(node_state_t::breaker_e state);
+
+    // must surround every request sent to node picked above
+    void on_start(int node);
+    void on_done(int node, uint64_t latency_us, bool ok);
+
+    size_t size() const { return m_nodes.size(); }
+    node_state_t const& node(size_t i) const { return *m_nodes[i]; }
+
+    policy_e policy() const { return m_policy; }
+
+    static policy_e policy_by_name(std::string const& name);
+    static const char* policy_name(policy_e policy);
+
+private:
+    template<class F>
+    int pick_if(size_t n, F const& has_conn, int exclude);
+
+    double score(size_t node, uint64_t now) const;
+
+    // node may get request (breaker is closed or probe is allowed)
+    bool admits(size_t node, uint64_t now) const;
+    // request picked for node with not closed breaker is probe
+    void on_probe(size_t node, uint64_t now);
+    void update_breaker(node_state_t& n, bool ok);
+
+    breaker_opts_t                              m_breaker;
+
+    policy_e                                    m_policy;
+    std::vector< std::unique_ptr<node_state_t> > m_nodes;
+    std::atomic<size_t>                         m_next;     // for round-robin
+};
+
+#endif //BALANCER_HPP
@@ -3,14 +3,23 @@
 #include <pthread.h>
 #include <cassert>
 #include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <thread>
 #include <unistd.h>
 
+#include "lane_queue.hpp"
 #include "exception.hpp"
 #include "logger.hpp"
 #include "condvar.hpp"
 #include "utils.hpp"
 
 #include "riak_iface.hpp"
+#include "balancer.hpp"
 
 
 #define CHECK(CMD) do{ \
@@ -19,46 +28,248 @@
         throw Exception( #CMD " failed with code: " + std::to_string(s)); \
     } while(0)
 
+// number of threads making the first connections
+static const size_t MAX_CONNECTORS = 32;
+
+// state shared by GET and its hedged duplicate
+struct hedge_state_t {
+    std::atomic_bool     done;      // reply received (the first one wins)
+    std::atomic<int>     node;      // node original request was sent to
+    std::atomic<int64_t> sent_us;   // when it was sent (0 - not sent yet)
+
+    hedge_state_t(): done(false), node(-1), sent_us(0) {}
+};
+
+// limit of retry budget, 1/1000 of token (see retry_opts_t)
+static const int64_t RETRY_TOKENS_MAX = 100 * 1000;
+
+static int64_t steady_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 struct command_t {
-    enum class op_e {
-        PUT = 0,
-        GET,
-        DELETE,
-    }           type;
+    op_e        type;
     
     std::string key;
     
     // ignored for GET or DEL operations
     std::string value;
 
-    // callback is used for GET operations
-    std::function<void(std::string)> cb;
+    // zero-copy alternative for key/value (value for PUT only):
+    //  memory is owned by caller (see executor_t::put_key_ref, get_key_ref)
+    slice_t     key_ref;
+    slice_t     value_ref;
+
+    slice_t key_slice() const { return key_ref.data ? key_ref : slice_t(key); }
+    slice_t value_slice() const { return value_ref.data ? value_ref : slice_t(value); }
+
+    // completion callback (optional), GET result is passed to it
+    done_cb_t   cb;
+    // or GET result is passed as view (see executor_t::get_key_ref)
+    view_cb_t   view_cb;
+
+    // time when command was put into queue (for latency statistics)
+    std::chrono::steady_clock::time_point enqueued;
+
+    // command is dropped if it is not sent to Riak before this time
+    deadline_t  deadline;
+
+    // queue lane
+    priority_e  priority;
+
+    // GET which may be hedged (see executor_opts_t::hedge)
+    std::shared_ptr<hedge_state_t> hedge;
+    bool        is_hedge;       // this is duplicate
+
+    // flush epoch command was issued in (see executor_t::sync)
+    uint64_t    epoch;
+
+    // failed attempts and node of the last one (see retry_opts_t)
+    unsigned    attempts;
+    int         failed_node;
+
+    // stage timestamps of sampled command (see executor_opts_t::trace_every),
+    //  ENQUEUE one is 0 if command is not sampled
+    int64_t     stage_ns[STAGES];
+
+    bool is_sampled() const { return stage_ns[int(stage_e::ENQUEUE)] != 0; }
+    void stamp(stage_e stage, int64_t ns) { if (is_sampled()) stage_ns[int(stage)] = ns; }
+
+    command_t(): deadline(deadline_t::max()), priority(priority_e::NORMAL), is_hedge(false), epoch(0),
+                 attempts(0), failed_node(-1) { stage_ns[int(stage_e::ENQUEUE)] = 0; }
 };
 
 struct executor_t::impl_t {
-    queue<command_t, strategy_drop_first<command_t> >     m_queue;
+    lane_queue<command_t> m_queue;      // lane is command priority
     strvector            m_addrs;
 
-    size_t               m_cmd_executor_thr_id;
     size_t               m_reconnector_thr_id;
+    size_t               m_hedger_thr_id;
 
 
     // general flag which indicates that everything goes down
     std::atomic_bool     m_stoping;
-    
-    std::vector<riak_iface_ptr> m_riaks;
 
-    // group of queues used for asynchronous reconnect of Riak clienhts
-    //  these queues used between Command processor and Reconnector
-    queue<riak_iface_ptr>  m_to_reconnect;
-    queue<riak_iface_ptr>  m_from_reconnect;
+    // Command processor thread with its own set of Riak clients
+    struct worker_t {
+        impl_t              *owner;
+        size_t               index;
+        size_t               thr_id;
+        std::vector<int>     cpus;
+
+        // statistics shard, allocated by worker itself after pinning
+        //  (so memory is local to worker's NUMA node)
+        std::atomic<executor_stats_t*> stats;
+
+        // client for every node (index is node number),
+        //  empty while client is being reconnected
+        std::vector<riak_iface_ptr> riaks;
+        size_t                      missing;
+
+        // clients returned by Connectors and Reconnector
+        queue< std::pair<size_t, riak_iface_ptr> > from_reconnect;
+
+        // clients for this worker are being created
+        bool                        connect_requested;
+
+        // operations of pipeline and their results (reused)
+        std::vector<riak_iface::op_t> ops;
+        std::vector<std::string>      results;
+
+        worker_t(): stats(0), missing(0), connect_requested(false) {}
+        ~worker_t() { delete stats.load(); }
+    };
+    std::vector< std::unique_ptr<worker_t> > m_workers;
+
+    // workers after the first m_active ones are parked
+    //  (they keep their connections, see set_workers)
+    std::atomic<size_t>     m_active;
+    std::mutex              m_park_mutex;
+    std::condition_variable m_park_cond;
+
+    impl_t(executor_opts_t const& opts): m_queue(opts.lane_weights) {}
+
+    // picks node for each command
+    std::unique_ptr<balancer_t> m_balancer;
+
+    // connection of inline pool (see executor_opts_t::dispatch),
+    //  caller thread owns it while it is BUSY
+    struct inline_slot_t {
+        enum { DOWN = 0, FREE, BUSY };
+        std::atomic<int> state;
+        riak_iface_ptr   riak;
+
+        inline_slot_t(): state(DOWN) {}
+    };
+
+    // queue used for asynchronous reconnect of Riak clients
+    //  (between Command processors and Reconnector)
+    struct reconnect_t {
+        riak_iface_ptr  riak;
+        size_t          node;
+        worker_t       *worker;
+        inline_slot_t  *slot;       // client of inline pool (worker is 0 then)
+    };
+    queue<reconnect_t>     m_to_reconnect;
+
+    // the first connection of clients is made by pool of Connector threads
+    std::string            m_backend;
+    std::vector< std::pair<std::string, int> > m_endpoints;  // host and port of node
+    queue<reconnect_t>     m_to_connect;
+    std::vector<size_t>    m_connector_thr_ids;
+    int                    m_connect_timeout_ms;
+    bool                   m_lazy_connect;
+
+    // max commands sent to node without waiting for responses
+    size_t                 m_pipeline;
+
+    // number of requested connections which are not finished yet
+    std::atomic<size_t>    m_connecting;
+    std::mutex             m_connect_mutex;
+    std::condition_variable m_connect_cond;
+
+    // creates clients for worker and sends them to Connectors
+    void request_connect(worker_t *w);
+
+    // inline dispatch: per-node pools of connections used by caller threads
+    dispatch_e             m_dispatch;
+    size_t                 m_inline_conns;
+    std::vector< std::unique_ptr<inline_slot_t[]> > m_inline_pool;
+    std::atomic<bool>      m_inline_connect_requested;
+    executor_stats_t       m_inline_stats;
+
+    // creates clients of inline pool (once)
+    void request_inline_connect();
+    // takes free connection to node, 0 if all of them are busy or down
+    inline_slot_t* checkout(size_t node);
+    // executes GET in caller thread, false if no connection is ready
+    //  (command is not issued then)
+    bool exec_inline(command_t& cmd, op_opts_t const& opts);
 
     //
     void start_thread();
     void stop_thread(bool stop_now);
     bool is_thread_active() const;
 
-    void exec(command_t const& cmd);
+    void exec(command_t& cmd, op_opts_t const& opts);
+
+    // default time limit of operation (zero - no limit)
+    std::atomic<int64_t> m_timeout_us;
+    deadline_t deadline_of(op_opts_t const& opts) const;
+
+    // completes command which missed its deadline
+    void expire(command_t& cmd, executor_stats_t& stats);
+
+    // retries of failed commands
+    retry_opts_t           m_retry;
+    std::atomic<int64_t>   m_retry_tokens;      // budget, 1/1000 of token
+
+    // takes token for retry of failed command
+    bool may_retry(command_t const& cmd);
+
+    // stage tracing
+    std::unique_ptr<stage_tracer_t> m_tracer;
+    size_t                 m_trace_every;
+
+    // picks one of m_trace_every commands
+    void sample(command_t& cmd);
+    // sampled command is done
+    void trace(worker_t *w, command_t& cmd, size_t batch);
+    // completes command which is not retried
+    void fail(command_t& cmd, executor_stats_t& stats);
+
+    // flush fences: commands are counted per epoch they were issued in,
+    //  fence closes current epoch and is passed when it and all older
+    //  ones have no commands left (m_oldest moves over drained epochs).
+    //  Counters are reused in ring, so new epoch is opened only when
+    //  its counter does not belong to epoch which is not drained yet.
+    //  Epoch and fences are changed under m_fence_mutex
+    static const size_t    EPOCHS = 64;
+    std::atomic<uint64_t>  m_epoch;
+    std::atomic<int64_t>   m_epoch_pending[EPOCHS];
+    std::atomic<uint64_t>  m_oldest;            // epochs before it are drained
+    bool                   m_close_pending;     // epoch is closed when ring has room
+    std::atomic<size_t>    m_fence_waiters;     // completions wake them up
+    std::mutex             m_fence_mutex;
+    std::condition_variable m_fence_cond;
+    struct fence_t {
+        uint64_t  limit;
+        sync_cb_t cb;
+    };
+    std::vector<fence_t>   m_fences;            // asynchronous ones
+
+    void issued(command_t& cmd);
+    void completed(command_t const& cmd);
+    // new fence, returns epoch it waits for (see is_passed)
+    uint64_t open_fence();
+    // moves m_oldest over drained epochs and closes epoch if requested
+    void advance_epochs();
+    // epochs before 'limit' are drained
+    bool is_passed(uint64_t limit) const { return m_oldest.load() >= limit; }
+    // calls asynchronous fences which are passed (or all if executor stops)
+    void notify_fences(bool stoping);
 
     // Main work cycle - processing of commands
     enum class mode_e {
@@ -68,12 +279,39 @@ struct executor_t::impl_t {
     };
     std::atomic<mode_e>  m_cur_mode;
 
+    recorder_t           m_recorder;
+
+    std::vector<int>     m_reconnector_cpus;
+
+    // hedging of GETs
+    std::mutex             m_hedge_opts_mutex;  // for changes of options below
+    hedge_opts_t           m_hedge;
+    std::atomic<bool>      m_hedge_on;
+    std::atomic<double>    m_hedge_percentile;
+    std::atomic<double>    m_hedge_budget_pct;
+    std::mutex             m_hedge_mutex;
+    std::vector<command_t> m_hedge_pending;     // GETs which may need duplicate
+    std::atomic<int64_t>   m_hedge_delay_us;    // 0 - not known yet
+    histogram_t            m_get_latency;       // for adaptive delay
+    std::atomic<uint64_t>  m_gets;              // GETs issued (for budget)
+    std::atomic<uint64_t>  m_hedges;
+
+    // picks node for command, -1 if command is done without sending
+    int prepare(worker_t *w, command_t& cmd, executor_stats_t& stats);
+    // sends commands to node (as one pipeline if there are several)
+    void execute(worker_t *w, int node, std::vector<command_t*> const& cmds,
+                 executor_stats_t& stats);
+
     // main threads
-    void cmd_processor();
+    void cmd_processor(worker_t *w);
     void reconnector();
+    void connector();
+    void hedger();
 
-    // Reconnector thread
+    // Reconnector, Connector and Hedger threads
     void start_reconnector_thread();
+    void start_connector_threads(size_t count);
+    void start_hedger_thread();
 
     // thread helpers
     static void* thr_cmd_processor(void *arg);
@@ -82,18 +320,56 @@ struct executor_t::impl_t {
 //
 
 
-executor_t::executor_t(strvector const& addrlist)
-    : m_impl(new impl_t)
+executor_t::executor_t(strvector const& addrlist, executor_opts_t const& opts)
+    : m_impl(new impl_t(opts))
 {
     // create Riak instances
     if (addrlist.empty())
         throw Exception("executor_t got empty list of addresses");
+    if (opts.workers == 0)
+        throw Exception("executor_t needs at least one worker");
+    if (opts.max_workers != 0 && opts.max_workers < opts.workers)
+        throw Exception("executor_t max_workers is less than workers");
+    if (opts.lane_weights.size() != 3)
+        throw Exception("executor_t needs weight for each priority lane");
+    if (!is_riak_backend(opts.backend))
+        throw Exception("Unknown Riak backend <" + opts.backend + ">");
 
-    m_impl->m_cmd_executor_thr_id = 0;
     m_impl->m_reconnector_thr_id = 0;
+    m_impl->m_hedger_thr_id = 0;
+    m_impl->m_connect_timeout_ms = int(opts.connect_timeout_ms);
+    m_impl->m_lazy_connect = opts.lazy_connect;
+    m_impl->m_pipeline = std::max<size_t>(opts.pipeline, 1);
+    m_impl->m_trace_every = opts.trace_every;
+    m_impl->m_dispatch = opts.dispatch;
+    m_impl->m_inline_conns = std::max<size_t>(opts.inline_conns, 1);
+    m_impl->m_inline_connect_requested.store(false);
+    m_impl->m_backend = opts.backend;
+    m_impl->m_connecting.store(0);
     m_impl->m_cur_mode.store(impl_t::mode_e::RUN);
     m_impl->m_stoping.store(false);
 
+    // threads without placement run where creator of executor is allowed to
+    std::vector<int> default_cpus = current_thread_cpus();
+
+    // extra workers are created parked
+    size_t max_workers = std::max(opts.workers, opts.max_workers);
+    m_impl->m_active.store(opts.workers);
+
+    for(size_t i = 0; i < max_workers; i++)
+    {
+        std::unique_ptr<impl_t::worker_t> w(new impl_t::worker_t);
+        w->owner  = m_impl;
+        w->index  = i;
+        w->thr_id = 0;
+        w->cpus   = opts.worker_cpus.empty() ? default_cpus : opts.worker_cpus.cpus_for(i);
+        m_impl->m_workers.push_back(std::move(w));
+    }
+    if (opts.trace_every > 0)
+        m_impl->m_tracer.reset(new stage_tracer_t(max_workers));
+    m_impl->m_reconnector_cpus = opts.reconnector_cpus.empty() ? default_cpus
+                                                               : opts.reconnector_cpus.cpus;
+
     for(std::string const& addr : addrlist)
     {
         std::string host;
@@ -104,18 +380,70 @@ executor_t::executor_t(strvector const& addrlist)
             continue;
         }
 
-        // create instance
-        LOG << "Creating RIAK client for " << addr << endl;
-        m_impl->m_riaks.push_back( create_riak_instance(host, port) );
+        // slot for every worker, filled when client is connected
+        for(auto& w : m_impl->m_workers)
+        {
+            w->riaks.push_back(riak_iface_ptr());
+            w->missing++;
+        }
+
+        m_impl->m_addrs.push_back(addr);
+        m_impl->m_endpoints.push_back(std::make_pair(host, port));
     }
 
     // check if there is no Riak clients was created
-    if (m_impl->m_riaks.empty())
+    if (m_impl->m_addrs.empty())
         throw Exception("No Riak clients can be created");
+
+    m_impl->m_balancer.reset(new balancer_t(opts.balancer, m_impl->m_addrs));
+    m_impl->m_balancer->set_breaker(opts.breaker);
+
+    size_t inline_conns = 0;
+    if (opts.dispatch == dispatch_e::INLINE)
+    {
+        inline_conns = m_impl->m_inline_conns;
+        for(size_t node = 0; node < m_impl->m_addrs.size(); node++)
+            m_impl->m_inline_pool.emplace_back(new impl_t::inline_slot_t[inline_conns]);
+    }
+
+    // all connections are made in parallel
+    m_impl->start_connector_threads(std::min<size_t>(m_impl->m_addrs.size() * (opts.workers + inline_conns),
+                                                     MAX_CONNECTORS));
+    if (!opts.lazy_connect)
+    {
+        LOG << "Connecting to " << m_impl->m_addrs.size() << " Riak node(s)" << endl;
+        for(size_t i = 0; i < opts.workers; i++)
+            m_impl->request_connect(m_impl->m_workers[i].get());
+        if (opts.dispatch == dispatch_e::INLINE)
+            m_impl->request_inline_connect();
+
+        // nodes which did not answer in time are connected in background
+        //  (or go to Reconnector)
+        std::unique_lock<std::mutex> lock(m_impl->m_connect_mutex);
+        if (!m_impl->m_connect_cond.wait_for(lock, std::chrono::milliseconds(m_impl->m_connect_timeout_ms + 100),
+                                             [this] { return m_impl->m_connecting.load() == 0; }))
+            LOG_W << m_impl->m_connecting.load() << " connection(s) are not established in time" << endl;
+    }
+
+    set_timeout(opts.timeout_ms);
+
+    m_impl->m_gets.store(0);
+    m_impl->m_hedges.store(0);
+
+    m_impl->m_retry = opts.retry;
+    m_impl->m_retry_tokens.store(RETRY_TOKENS_MAX);
+
+    m_impl->m_epoch.store(0);
+    for(auto& e : m_impl->m_epoch_pending)
+        e.store(0);
+    m_impl->m_oldest.store(0);
+    m_impl->m_close_pending = false;
+    m_impl->m_fence_waiters.store(0);
     
     // start threads
     m_impl->start_thread();
     m_impl->start_reconnector_thread();
+    set_hedge(opts.hedge);
 }
 
 executor_t::~executor_t()
@@ -129,63 +457,429 @@ void executor_t::stop(bool stop_now)
 
     m_impl->m_stoping.store(true);
     m_impl->stop_thread(stop_now);
+
+    {
+        std::lock_guard<std::mutex> lock(m_impl->m_hedge_opts_mutex);
+        if (m_impl->m_hedger_thr_id != 0)
+        {
+            pthread_join(m_impl->m_hedger_thr_id, 0);
+            m_impl->m_hedger_thr_id = 0;
+        }
+    }
+
+    // empty request wakes up Connector to exit
+    for(size_t i = 0; i < m_impl->m_connector_thr_ids.size(); i++)
+        m_impl->m_to_connect.enqueue(impl_t::reconnect_t{ riak_iface_ptr(), 0, 0, 0 });
+    for(size_t id : m_impl->m_connector_thr_ids)
+        pthread_join(id, 0);
+    m_impl->m_connector_thr_ids.clear();
+
+    // commands left in queue never complete
+    m_impl->notify_fences(true);
 }
 
 void executor_t::sync()
 {
-    // restart internal thread
-    m_impl->stop_thread(false);
-    m_impl->start_thread();
+    sync_for(0);
 }
 
-bool executor_t::put_key(std::string const& key, std::string const& value)
+bool executor_t::sync_for(double timeout_ms)
+{
+    impl_t *impl = m_impl;
+
+    // completions look for waiters only after their counter drops to zero
+    impl->m_fence_waiters.fetch_add(1);
+
+    std::unique_lock<std::mutex> lock(impl->m_fence_mutex);
+    uint64_t limit = impl->open_fence();
+    auto ready = [impl, limit] { return impl->m_stoping.load() || impl->is_passed(limit); };
+    if (timeout_ms > 0)
+        impl->m_fence_cond.wait_for(lock, std::chrono::microseconds(int64_t(timeout_ms * 1000)), ready);
+    else
+        impl->m_fence_cond.wait(lock, ready);
+    bool passed = impl->is_passed(limit);
+    lock.unlock();
+
+    impl->m_fence_waiters.fetch_sub(1);
+    return passed;
+}
+
+void executor_t::sync_async(sync_cb_t const& cb)
+{
+    impl_t *impl = m_impl;
+
+    // counted before the check, so last completion does not miss the fence
+    impl->m_fence_waiters.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(impl->m_fence_mutex);
+        uint64_t limit = impl->open_fence();
+        if (!impl->m_stoping.load() && !impl->is_passed(limit))
+        {
+            impl->m_fences.push_back(impl_t::fence_t{ limit, cb });
+            return;
+        }
+    }
+    impl->m_fence_waiters.fetch_sub(1);
+
+    cb(!impl->m_stoping.load());
+}
+
+size_t executor_t::workers() const
+{
+    return m_impl->m_active.load();
+}
+
+size_t executor_t::set_workers(size_t count)
+{
+    count = std::max<size_t>(1, std::min(count, m_impl->m_workers.size()));
+
+    {
+        std::lock_guard<std::mutex> lock(m_impl->m_park_mutex);
+        m_impl->m_active.store(count);
+    }
+    m_impl->m_park_cond.notify_all();
+
+    LOG << "Active workers: " << count << endl;
+    return count;
+}
+
+void executor_t::set_hedge(hedge_opts_t const& opts)
+{
+    std::lock_guard<std::mutex> lock(m_impl->m_hedge_opts_mutex);
+
+    m_impl->m_hedge = opts;
+    m_impl->m_hedge_percentile.store(opts.percentile);
+    m_impl->m_hedge_budget_pct.store(opts.budget_pct);
+    m_impl->m_hedge_delay_us.store(opts.percentile > 0 ? 0 : int64_t(opts.delay_ms * 1000));
+    m_impl->m_hedge_on.store(opts.enabled());
+
+    // Hedger is started when hedging is enabled the first time
+    if (opts.enabled() && m_impl->m_hedger_thr_id == 0 && !m_impl->m_stoping.load())
+        m_impl->start_hedger_thread();
+}
+
+hedge_opts_t executor_t::hedge() const
+{
+    std::lock_guard<std::mutex> lock(m_impl->m_hedge_opts_mutex);
+    return m_impl->m_hedge;
+}
+
+void executor_t::set_timeout(double timeout_ms)
+{
+    m_impl->m_timeout_us.store(int64_t(timeout_ms * 1000));
+}
+
+double executor_t::timeout_ms() const
+{
+    return m_impl->m_timeout_us.load() / 1000.0;
+}
+
+const char* priority_name(priority_e priority)
+{
+    switch(priority)
+    {
+    case priority_e::INTERACTIVE: return "interactive";
+    case priority_e::NORMAL:      return "normal";
+    case priority_e::BULK:        return "bulk";
+    }
+    return "unknown";
+}
+
+const char* dispatch_name(dispatch_e dispatch)
+{
+    switch(dispatch)
+    {
+    case dispatch_e::QUEUED: return "queued";
+    case dispatch_e::INLINE: return "inline";
+    }
+    return "unknown";
+}
+
+dispatch_e dispatch_by_name(std::string const& name)
+{
+    if (name == "queued")
+        return dispatch_e::QUEUED;
+    if (name == "inline")
+        return dispatch_e::INLINE;
+    throw Exception("Unknown dispatch mode <" + name + ">");
+}
+
+op_opts_t op_opts_t::timeout_ms(double ms, priority_e priority)
+{
+    op_opts_t r(priority);
+    r.deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(int64_t(ms * 1000));
+    return r;
+}
+
+bool executor_t::put_key(std::string const& key, std::string const& value, op_opts_t const& opts)
 {
     if (!m_impl->is_thread_active())
         return false;
     
     command_t cmd;
-    cmd.type = command_t::op_e::PUT;
+    cmd.type = op_e::PUT;
     cmd.key = key;
     cmd.value = value;
 
-    m_impl->exec(cmd);
+    m_impl->exec(cmd, opts);
+    return true;
 }
 
-std::string executor_t::get_key(std::string const& key)
+bool executor_t::put_key_ref(slice_t const& key, slice_t const& value, op_opts_t const& opts)
 {
     if (!m_impl->is_thread_active())
-        return "";
+        return false;
+
+    command_t cmd;
+    cmd.type = op_e::PUT;
+    cmd.key_ref = key;
+    cmd.value_ref = value;
+
+    m_impl->exec(cmd, opts);
+    return true;
+}
+
+bool executor_t::get_key_ref(slice_t const& key, view_cb_t const& cb, op_opts_t const& opts)
+{
+    if (!m_impl->is_thread_active())
+        return false;
+
+    command_t cmd;
+    cmd.type = op_e::GET;
+    cmd.key_ref = key;
+    cmd.view_cb = cb;
 
+    m_impl->exec(cmd, opts);
+    return true;
+}
+
+bool executor_t::put_batch(kv_batch_t const& batch, op_opts_t const& opts)
+{
+    return put_batch(batch, done_cb_t(), opts);
+}
+
+bool executor_t::put_batch(kv_batch_t const& batch, done_cb_t const& cb, op_opts_t const& opts)
+{
+    if (!m_impl->is_thread_active())
+        return false;
+
+    deadline_t deadline = m_impl->deadline_of(opts);
+
+    std::vector<command_t> cmds(batch.size());
+    for(size_t i = 0; i < batch.size(); i++)
+    {
+        cmds[i].type = op_e::PUT;
+        cmds[i].deadline = deadline;
+        cmds[i].priority = opts.priority;
+        cmds[i].key_ref = batch[i].first;
+        cmds[i].value_ref = batch[i].second;
+        cmds[i].cb = cb;
+        cmds[i].enqueued = std::chrono::steady_clock::now();
+        m_impl->issued(cmds[i]);
+        m_impl->sample(cmds[i]);
+
+        if (m_impl->m_recorder)
+            m_impl->m_recorder(op_e::PUT, batch[i].first, batch[i].second.size);
+    }
+
+    m_impl->m_queue.enqueue(size_t(opts.priority), cmds.begin(), cmds.end());
+    return true;
+}
+
+size_t executor_t::pending() const
+{
+    return m_impl->m_queue.size();
+}
+
+size_t executor_t::pending(priority_e priority) const
+{
+    return m_impl->m_queue.size(size_t(priority));
+}
+
+void executor_t::set_recorder(recorder_t const& recorder)
+{
+    m_impl->m_recorder = recorder;
+}
+
+stage_tracer_t* executor_t::stage_tracer() const
+{
+    return m_impl->m_tracer.get();
+}
+
+void executor_t::collect_stats(executor_stats_t& dst)
+{
+    // rings of workers are emptied regularly
+    if (m_impl->m_tracer)
+        m_impl->m_tracer->collect();
+
+    uint64_t ops[3] = { 0 }, errors[3] = { 0 }, timeouts[3] = { 0 }, hedge_wins = 0, retries = 0, failed = 0;
+
+    // shards of workers and the one of inline GETs
+    std::vector<executor_stats_t*> shards;
+    for(auto& w : m_impl->m_workers)
+        shards.push_back(w->stats.load());
+    shards.push_back(&m_impl->m_inline_stats);
+
+    for(executor_stats_t *st : shards)
+    {
+        if (!st)
+            continue;
+
+        for(int i = 0; i < 3; i++)
+        {
+            ops[i]      += st->op[i].ops.load(std::memory_order_relaxed);
+            errors[i]   += st->op[i].errors.load(std::memory_order_relaxed);
+            timeouts[i] += st->op[i].timeouts.load(std::memory_order_relaxed);
+            st->op[i].latency.drain_to(dst.op[i].latency);
+            st->queue_delay[i].drain_to(dst.queue_delay[i]);
+        }
+        hedge_wins += st->hedge_wins.load(std::memory_order_relaxed);
+        retries    += st->retries.load(std::memory_order_relaxed);
+        failed     += st->failed.load(std::memory_order_relaxed);
+    }
+
+    for(int i = 0; i < 3; i++)
+    {
+        dst.op[i].ops.store(ops[i]);
+        dst.op[i].errors.store(errors[i]);
+        dst.op[i].timeouts.store(timeouts[i]);
+    }
+    dst.hedges.store(m_impl->m_hedges.load());
+    dst.hedge_wins.store(hedge_wins);
+    dst.retries.store(retries);
+    dst.failed.store(failed);
+}
+
+std::vector<executor_t::node_info_t> executor_t::nodes() const
+{
+    std::vector<node_info_t> r;
+    for(size_t i = 0; i < m_impl->m_balancer->size(); i++)
+    {
+        node_state_t const& n = m_impl->m_balancer->node(i);
+
+        node_info_t info;
+        info.addr        = n.addr;
+        info.selected    = n.selected.load();
+        info.failures    = n.failures.load();
+        info.outstanding = n.outstanding.load();
+        info.ewma_us     = n.ewma_us.load();
+        info.breaker     = balancer_t::breaker_name(n.breaker.load());
+        info.breaker_opened = n.breaker_opened.load();
+        r.push_back(info);
+    }
+    return r;
+}
+
+std::string executor_t::layout() const
+{
+    std::string r;
+    for(size_t i = 0; i < m_impl->m_workers.size(); i++)
+        r += "worker" + std::to_string(i) + "=" + describe_cpus(m_impl->m_workers[i]->cpus) + " ";
+
+    return r + "reconnector=" + describe_cpus(m_impl->m_reconnector_cpus);
+}
+
+bool executor_t::put_key(std::string const& key, std::string const& value, done_cb_t const& cb,
+                         op_opts_t const& opts)
+{
+    if (!m_impl->is_thread_active())
+        return false;
+
+    command_t cmd;
+    cmd.type = op_e::PUT;
+    cmd.key = key;
+    cmd.value = value;
+    cmd.cb = cb;
+
+    m_impl->exec(cmd, opts);
+    return true;
+}
+
+bool executor_t::get_key(std::string const& key, done_cb_t const& cb, op_opts_t const& opts)
+{
+    if (!m_impl->is_thread_active())
+        return false;
+
+    command_t cmd;
+    cmd.type = op_e::GET;
+    cmd.key = key;
+    cmd.cb = cb;
+
+    m_impl->exec(cmd, opts);
+    return true;
+}
+
+bool executor_t::del_key(std::string const& key, done_cb_t const& cb, op_opts_t const& opts)
+{
+    if (!m_impl->is_thread_active())
+        return false;
+
+    command_t cmd;
+    cmd.type = op_e::DELETE;
+    cmd.key = key;
+    cmd.cb = cb;
+
+    m_impl->exec(cmd, opts);
+    return true;
+}
+
+std::string executor_t::get_key(std::string const& key, op_opts_t const& opts)
+{
     std::string result;
+    get_key(key, &result, opts);
+    return result;
+}
+
+bool executor_t::get_key(std::string const& key, std::string *value, op_opts_t const& opts)
+{
+    value->clear();
+    if (!m_impl->is_thread_active())
+        return false;
+
+    bool done = false;
+    status_e status = status_e::OK;
     mutex_t m;
     condvar_t cv(m);
-    
+
+    // value is copied right from client's buffer into caller's one
     command_t cmd;
-    cmd.type = command_t::op_e::GET;
+    cmd.type = op_e::GET;
     cmd.key = key;
-    cmd.cb = [&cv, &result] (std::string const& value)
+    cmd.view_cb = [&m, &cv, &done, &status, value] (status_e st, slice_t const& v)
         {
-            result = value;
+            m.lock();
+            value->assign(v.data, v.size);
+            status = st;
+            done = true;
             cv.signal();
+            m.unlock();
         };
 
-    m_impl->exec(cmd);
+    // inline GET is usually done on return, queue is used when
+    //  there is no ready connection
+    if (m_impl->m_dispatch != dispatch_e::INLINE || !m_impl->exec_inline(cmd, opts))
+        m_impl->exec(cmd, opts);
 
-    cv.wait();
+    // flag protects from signal which came before wait()
+    m.lock();
+    while (!done)
+        cv.wait();
+    m.unlock();
 
-    return result;
+    return status == status_e::OK;
 }
 
-bool executor_t::del_key(std::string const& key)
+bool executor_t::del_key(std::string const& key, op_opts_t const& opts)
 {
     if (!m_impl->is_thread_active())
         return false;
 
     command_t cmd;
-    cmd.type = command_t::op_e::DELETE;
+    cmd.type = op_e::DELETE;
     cmd.key = key;
 
-    m_impl->exec(cmd);
+    m_impl->exec(cmd, opts);
+    return true;
 }
 //
 
@@ -194,16 +888,23 @@ bool executor_t::del_key(std::string const& key)
 // Implementation goes here
 void executor_t::impl_t::start_thread()
 {
-    LOG_D << "Starting internal thread" << endl;
+    LOG_D << "Starting internal threads (" << m_workers.size() << ")" << endl;
+
+    // mode must be set before threads start checking it
+    m_cur_mode.store(mode_e::RUN);
+
     pthread_attr_t attr;
     CHECK(pthread_attr_init(&attr));
-    CHECK(pthread_create(&m_cmd_executor_thr_id, &attr,
-                         [] (void *arg) -> void* { static_cast<impl_t*>(arg)->cmd_processor(); },
-                         this));
+    for(auto& w : m_workers)
+        CHECK(pthread_create(&w->thr_id, &attr,
+                             [] (void *arg) -> void* {
+                                 worker_t *w = static_cast<worker_t*>(arg);
+                                 w->owner->cmd_processor(w);
+                                 return 0;
+                             },
+                             w.get()));
     
     CHECK(pthread_attr_destroy(&attr));
-
-    m_cur_mode.store(mode_e::RUN);
 }
 
 void executor_t::impl_t::start_reconnector_thread()
@@ -212,7 +913,79 @@ void executor_t::impl_t::start_reconnector_thread()
     pthread_attr_t attr;
     CHECK(pthread_attr_init(&attr));
     CHECK(pthread_create(&m_reconnector_thr_id, &attr,
-                         [] (void *arg) -> void* { static_cast<impl_t*>(arg)->reconnector(); },
+                         [] (void *arg) -> void* { static_cast<impl_t*>(arg)->reconnector(); return 0; },
+                         this));
+    CHECK(pthread_attr_destroy(&attr));
+}
+
+void executor_t::impl_t::start_connector_threads(size_t count)
+{
+    LOG_D << "Starting connector threads (" << count << ")" << endl;
+    pthread_attr_t attr;
+    CHECK(pthread_attr_init(&attr));
+    for(size_t i = 0; i < count; i++)
+    {
+        size_t id;
+        CHECK(pthread_create(&id, &attr,
+                             [] (void *arg) -> void* { static_cast<impl_t*>(arg)->connector(); return 0; },
+                             this));
+        m_connector_thr_ids.push_back(id);
+    }
+    CHECK(pthread_attr_destroy(&attr));
+}
+
+void executor_t::impl_t::request_connect(worker_t *w)
+{
+    w->connect_requested = true;
+
+    for(size_t node = 0; node < m_endpoints.size(); node++)
+    {
+        m_connecting.fetch_add(1);
+        m_to_connect.enqueue(reconnect_t{ create_riak_instance(m_backend, m_endpoints[node].first,
+                                                                m_endpoints[node].second),
+                                          node, w, 0 });
+    }
+}
+
+void executor_t::impl_t::request_inline_connect()
+{
+    if (m_inline_connect_requested.exchange(true))
+        return;
+
+    for(size_t node = 0; node < m_endpoints.size(); node++)
+        for(size_t i = 0; i < m_inline_conns; i++)
+        {
+            inline_slot_t& slot = m_inline_pool[node][i];
+            slot.riak = create_riak_instance(m_backend, m_endpoints[node].first, m_endpoints[node].second);
+
+            m_connecting.fetch_add(1);
+            m_to_connect.enqueue(reconnect_t{ slot.riak, node, 0, &slot });
+        }
+}
+
+executor_t::impl_t::inline_slot_t* executor_t::impl_t::checkout(size_t node)
+{
+    // threads start from different slots, so they rarely collide
+    static thread_local size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+
+    inline_slot_t *slots = m_inline_pool[node].get();
+    for(size_t i = 0; i < m_inline_conns; i++)
+    {
+        inline_slot_t& slot = slots[(start + i) % m_inline_conns];
+        int state = inline_slot_t::FREE;
+        if (slot.state.compare_exchange_strong(state, inline_slot_t::BUSY, std::memory_order_acquire))
+            return &slot;
+    }
+    return 0;
+}
+
+void executor_t::impl_t::start_hedger_thread()
+{
+    LOG_D << "Starting hedger thread" << endl;
+    pthread_attr_t attr;
+    CHECK(pthread_attr_init(&attr));
+    CHECK(pthread_create(&m_hedger_thr_id, &attr,
+                         [] (void *arg) -> void* { static_cast<impl_t*>(arg)->hedger(); return 0; },
                          this));
     CHECK(pthread_attr_destroy(&attr));
 }
@@ -220,23 +993,364 @@ void executor_t::impl_t::start_reconnector_thread()
 void executor_t::impl_t::stop_thread(bool stop_now)
 {
     LOG_D << "New mode: " << (stop_now ? "STOP_NOW" : "STOP_WHEN_DONE") << endl;
-    m_cur_mode.store(stop_now ? mode_e::STOP_NOW : mode_e::STOP_WHEN_DONE);
-    pthread_join(m_cmd_executor_thr_id, 0);
-    m_cmd_executor_thr_id = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_park_mutex);
+        m_cur_mode.store(stop_now ? mode_e::STOP_NOW : mode_e::STOP_WHEN_DONE);
+    }
+    m_park_cond.notify_all();
+    for(auto& w : m_workers)
+    {
+        if (w->thr_id == 0)
+            continue;
+
+        pthread_join(w->thr_id, 0);
+        w->thr_id = 0;
+    }
 }
 
 bool executor_t::impl_t::is_thread_active() const
 {
-    return m_cmd_executor_thr_id != 0;
+    return m_workers.front()->thr_id != 0;
+}
+
+deadline_t executor_t::impl_t::deadline_of(op_opts_t const& opts) const
+{
+    if (opts.deadline != deadline_t())
+        return opts.deadline;
+
+    int64_t timeout_us = m_timeout_us.load(std::memory_order_relaxed);
+    if (timeout_us == 0)
+        return deadline_t::max();
+    return std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_us);
+}
+
+void executor_t::impl_t::expire(command_t& cmd, executor_stats_t& stats)
+{
+    // duplicate of hedged GET just disappears, the original one is completed
+    if (cmd.is_hedge)
+        return;
+    if (cmd.hedge && cmd.hedge->done.exchange(true))
+        return;
+
+    stats.op[int(cmd.type)].timeouts.fetch_add(1, std::memory_order_relaxed);
+
+    try {
+        if (cmd.cb)
+            cmd.cb(status_e::TIMEOUT, std::string());
+        if (cmd.view_cb)
+            cmd.view_cb(status_e::TIMEOUT, slice_t());
+    } catch (...) {}
+
+    completed(cmd);
+}
+
+void executor_t::impl_t::sample(command_t& cmd)
+{
+    if (m_trace_every == 0)
+        return;
+
+    static thread_local size_t counter = 0;
+    if (++counter % m_trace_every == 0)
+        cmd.stage_ns[int(stage_e::ENQUEUE)] = stage_tracer_t::now_ns();
+}
+
+void executor_t::impl_t::trace(worker_t *w, command_t& cmd, size_t batch)
+{
+    stage_sample_t s;
+    for(int i = 0; i < int(stage_e::COMPLETE); i++)
+        s.ns[i] = cmd.stage_ns[i];
+    s.ns[int(stage_e::COMPLETE)] = stage_tracer_t::now_ns();
+    s.op       = uint8_t(cmd.type);
+    s.attempts = uint8_t(std::min<unsigned>(cmd.attempts, 255));
+    s.batch    = uint16_t(std::min<size_t>(batch, 65535));
+    s.worker   = uint32_t(w->index);
+
+    m_tracer->push(w->index, s);
+}
+
+bool executor_t::impl_t::may_retry(command_t const& cmd)
+{
+    if (m_retry.max_attempts > 0 && cmd.attempts >= m_retry.max_attempts)
+        return false;
+    if (m_retry.budget_pct <= 0)
+        return true;
+
+    int64_t tokens = m_retry_tokens.load(std::memory_order_relaxed);
+    do {
+        if (tokens < 1000)
+            return false;
+    } while (!m_retry_tokens.compare_exchange_weak(tokens, tokens - 1000, std::memory_order_relaxed));
+    return true;
+}
+
+void executor_t::impl_t::fail(command_t& cmd, executor_stats_t& stats)
+{
+    // duplicate of hedged GET just disappears, the original one is completed
+    if (cmd.is_hedge)
+        return;
+    if (cmd.hedge && cmd.hedge->done.exchange(true))
+        return;
+
+    stats.failed.fetch_add(1, std::memory_order_relaxed);
+
+    try {
+        if (cmd.cb)
+            cmd.cb(status_e::ERROR, std::string());
+        if (cmd.view_cb)
+            cmd.view_cb(status_e::ERROR, slice_t());
+    } catch (...) {}
+
+    completed(cmd);
+}
+
+void executor_t::impl_t::issued(command_t& cmd)
+{
+    // new operation adds to retry budget
+    if (m_retry.budget_pct > 0
+        && m_retry_tokens.fetch_add(int64_t(m_retry.budget_pct * 10), std::memory_order_relaxed) > RETRY_TOKENS_MAX)
+        m_retry_tokens.store(RETRY_TOKENS_MAX, std::memory_order_relaxed);
+
+    // command which races with fence may be counted in closed epoch,
+    //  then fence just waits for it too. But if epoch is already drained,
+    //  its fences do not look at counter any more: command goes to newer one
+    for(;;)
+    {
+        cmd.epoch = m_epoch.load();
+        m_epoch_pending[cmd.epoch % EPOCHS].fetch_add(1);
+        if (cmd.epoch >= m_oldest.load())
+            break;
+        completed(cmd);
+    }
+}
+
+void executor_t::impl_t::completed(command_t const& cmd)
+{
+    if (m_epoch_pending[cmd.epoch % EPOCHS].fetch_sub(1) == 1 && m_fence_waiters.load() > 0)
+        notify_fences(false);
+}
+
+uint64_t executor_t::impl_t::open_fence()
+{
+    advance_epochs();
+
+    // commands of current epoch are done: fence waits for the older ones,
+    //  so repeated fence does not open new epoch
+    uint64_t epoch = m_epoch.load();
+    if (m_epoch_pending[epoch % EPOCHS].load() == 0)
+        return epoch;
+
+    if (epoch + 1 - m_oldest.load() < EPOCHS)
+        m_epoch.store(epoch + 1);
+    else
+        m_close_pending = true;
+    return epoch + 1;
+}
+
+void executor_t::impl_t::advance_epochs()
+{
+    uint64_t oldest = m_oldest.load();
+    for(;;)
+    {
+        uint64_t epoch = m_epoch.load();
+        while (oldest < epoch && m_epoch_pending[oldest % EPOCHS].load() == 0)
+        {
+            // command being issued in this epoch either sees it drained
+            //  (see issued) or is seen here
+            m_oldest.store(oldest + 1);
+            if (m_epoch_pending[oldest % EPOCHS].load() != 0)
+            {
+                m_oldest.store(oldest);
+                break;
+            }
+            oldest++;
+        }
+
+        // counter of next epoch is free now
+        if (!m_close_pending || epoch + 1 - oldest >= EPOCHS)
+            break;
+        m_epoch.store(epoch + 1);
+        m_close_pending = false;
+    }
 }
 
-void executor_t::impl_t::exec(command_t const& cmd)
+void executor_t::impl_t::notify_fences(bool stoping)
 {
-    m_queue.enqueue(cmd);
+    std::vector<fence_t> passed;
+    {
+        std::lock_guard<std::mutex> lock(m_fence_mutex);
+        advance_epochs();
+        m_fence_cond.notify_all();
+
+        size_t keep = 0;
+        for(size_t i = 0; i < m_fences.size(); i++)
+        {
+            if (stoping || is_passed(m_fences[i].limit))
+            {
+                passed.push_back(std::move(m_fences[i]));
+                continue;
+            }
+            if (keep != i)
+                m_fences[keep] = std::move(m_fences[i]);
+            keep++;
+        }
+        m_fences.resize(keep);
+    }
+
+    // callbacks may issue new commands or fences
+    for(auto& f : passed)
+    {
+        m_fence_waiters.fetch_sub(1);
+        try {
+            f.cb(!stoping);
+        } catch (...) {}
+    }
+}
+
+void executor_t::impl_t::exec(command_t& cmd, op_opts_t const& opts)
+{
+    cmd.deadline = deadline_of(opts);
+    cmd.priority = opts.priority;
+
+    if (m_recorder)
+        m_recorder(cmd.type, cmd.key_slice(), cmd.value_slice().size);
+
+    cmd.enqueued = std::chrono::steady_clock::now();
+    issued(cmd);
+    sample(cmd);
+
+    // remember GET so Hedger can duplicate it
+    //  (duplicate could outlive key owned by caller)
+    if (cmd.type == op_e::GET && !cmd.key_ref.data && m_hedge_on.load(std::memory_order_relaxed))
+    {
+        cmd.hedge = std::make_shared<hedge_state_t>();
+        m_gets.fetch_add(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(m_hedge_mutex);
+        m_hedge_pending.push_back(cmd);
+    }
+
+    m_queue.enqueue(size_t(cmd.priority), cmd);
+}
+
+bool executor_t::impl_t::exec_inline(command_t& cmd, op_opts_t const& opts)
+{
+    // pool is connected by the first inline GET when connection is lazy
+    if (!m_inline_connect_requested.load(std::memory_order_relaxed))
+        request_inline_connect();
+
+    // nodes which may have free connection
+    static thread_local std::vector<char> avail;
+    avail.assign(m_inline_pool.size(), 0);
+    size_t ready = 0;
+    for(size_t node = 0; node < m_inline_pool.size(); node++)
+        for(size_t i = 0; i < m_inline_conns && !avail[node]; i++)
+            if (m_inline_pool[node][i].state.load(std::memory_order_relaxed) == inline_slot_t::FREE)
+            {
+                avail[node] = 1;
+                ready++;
+            }
+    if (ready == 0)
+        return false;
+
+    cmd.deadline = deadline_of(opts);
+    cmd.priority = opts.priority;
+
+    if (m_recorder)
+        m_recorder(cmd.type, cmd.key_slice(), 0);
+
+    cmd.enqueued = std::chrono::steady_clock::now();
+    issued(cmd);
+
+    executor_stats_t& stats = m_inline_stats;
+    while (true)
+    {
+        auto started = std::chrono::steady_clock::now();
+        if (started >= cmd.deadline)
+        {
+            expire(cmd, stats);
+            return true;
+        }
+
+        // retry goes to another node, as in queue
+        int exclude = m_retry.other_node ? cmd.failed_node : -1;
+        int node = m_balancer->pick(avail, exclude);
+        if (node < 0 && exclude >= 0)
+            node = m_balancer->pick(avail);
+
+        if (node < 0)
+        {
+            // connections are lost: worker waits for reconnected ones
+            if (ready == 0)
+                m_queue.enqueue(size_t(cmd.priority), cmd);
+            else
+                fail(cmd, stats);   // breakers of all nodes are open
+            return true;
+        }
+
+        inline_slot_t *slot = checkout(node);
+        if (!slot)
+        {
+            avail[node] = 0;
+            ready--;
+            continue;
+        }
+
+        riak_iface_ptr& p = slot->riak;
+        if (cmd.deadline == deadline_t::max())
+            p->set_timeout(0);
+        else
+            p->set_timeout(std::chrono::duration_cast<std::chrono::milliseconds>(
+                               cmd.deadline - started).count() + 1);
+
+        m_balancer->on_start(node);
+
+        slice_t view;
+        int result = p->get_key_view(cmd.key_slice(), &view);
+
+        uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::steady_clock::now() - started).count();
+        bool failed = p->is_error_code(result);
+        m_balancer->on_done(node, elapsed, !failed);
+
+        if (failed)
+        {
+            stats.op[int(cmd.type)].errors.fetch_add(1, std::memory_order_relaxed);
+
+            // slot stays out of pool until Reconnector returns it
+            LOG_D << "Send inline client to reconnect (result code=" << result << ")" << endl;
+            slot->state.store(inline_slot_t::DOWN);
+            m_to_reconnect.enqueue(reconnect_t{ p, size_t(node), 0, slot });
+
+            cmd.attempts++;
+            cmd.failed_node = node;
+            if (!may_retry(cmd))
+            {
+                fail(cmd, stats);
+                return true;
+            }
+            stats.retries.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        op_stats_t& st = stats.op[int(cmd.type)];
+        st.ops.fetch_add(1, std::memory_order_relaxed);
+        st.latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::steady_clock::now() - cmd.enqueued).count());
+
+        // view points into client's buffer, so slot is released after callback
+        try {
+            if (cmd.view_cb)
+                cmd.view_cb(status_e::OK, view);
+        } catch (...) {}
+
+        slot->state.store(inline_slot_t::FREE, std::memory_order_release);
+        completed(cmd);
+        return true;
+    }
 }
 
 // threads
-void executor_t::impl_t::cmd_processor()
+void executor_t::impl_t::cmd_processor(worker_t *w)
 {
     LOG_D << "Main thread started" << endl;
 
@@ -244,21 +1358,75 @@ void executor_t::impl_t::cmd_processor()
     //  (i want to see if thread if finished in any case)
     try
     {       
+        try {
+            pin_current_thread(w->cpus);
+        } catch (std::exception const& ex) {
+            LOG_E << "Error: " << ex.what() << endl;
+        }
+
+        // first touch after pinning places statistics on local node
+        if (!w->stats.load())
+            w->stats.store(new executor_stats_t);
+        executor_stats_t& stats = *w->stats.load();
+
+        // reused between commands
+        std::vector<command_t>   batch;
+        std::vector<int>         nodes;
+        std::vector<command_t*>  group;
+
         while ( m_cur_mode.load() != mode_e::STOP_NOW )
         {
-            // waiting for alive Riak clients
-            if (m_riaks.empty()) {
-                LOG_D << "no Riak clients!" << endl;
-
-                // trying to get alive Riak client from Reconnector thread
-                riak_iface_ptr p;
-                if ( m_from_reconnect.dequeue(p, 1000) )
-                    m_riaks.push_back(p);
-                    
+            // parked worker waits until it is needed again
+            if (w->index >= m_active.load())
+            {
+                if (m_cur_mode.load() == mode_e::STOP_WHEN_DONE)
+                    break;
+
+                std::unique_lock<std::mutex> lock(m_park_mutex);
+                m_park_cond.wait_for(lock, std::chrono::milliseconds(1000),
+                                     [this, w] { return w->index < m_active.load()
+                                                     || m_cur_mode.load() != mode_e::RUN; });
                 continue;
             }
-            
-            
+
+            // take clients returned by Reconnector
+            //  (waiting for them if there is no alive client at all)
+            if (w->missing > 0)
+            {
+                bool none = w->missing == w->riaks.size();
+
+                // lazy connection: clients are created for the first command
+                if (!w->connect_requested)
+                {
+                    if (!m_queue.wait(1000))
+                    {
+                        if (m_cur_mode.load() == mode_e::STOP_WHEN_DONE)
+                            break;
+                        continue;
+                    }
+                    request_connect(w);
+                }
+
+                if (none)
+                {
+                    LOG_D << "no Riak clients!" << endl;
+
+                    // nothing can be done, but nothing is left too
+                    if (m_cur_mode.load() == mode_e::STOP_WHEN_DONE && m_queue.size() == 0)
+                        break;
+                }
+
+                std::pair<size_t, riak_iface_ptr> r;
+                if ( w->from_reconnect.dequeue(r, none ? 1000 : 0) )
+                {
+                    w->riaks[r.first] = r.second;
+                    w->missing--;
+                }
+
+                if (none)
+                    continue;
+            }
+
             // processign next command
             command_t cmd;
 
@@ -277,48 +1445,40 @@ void executor_t::impl_t::cmd_processor()
             if (m_cur_mode.load() == mode_e::STOP_NOW)
                 break;
 
-            // always use the first Riak client
-            riak_iface_ptr p = m_riaks.front();
+            // more commands for pipeline, if they are already waiting
+            batch.clear();
+            batch.push_back(std::move(cmd));
+            while (batch.size() < m_pipeline && m_queue.try_dequeue(cmd))
+                batch.push_back(std::move(cmd));
 
-            int result = 0;
-            std::string str_result;
-            switch(cmd.type)
+            if (m_tracer)
             {
-            case command_t::op_e::PUT:
-                result = p->put_key(cmd.key, cmd.value);
-                break;
-            case command_t::op_e::GET:
-                result = p->get_key(cmd.key, &str_result);
-                break;
-            case command_t::op_e::DELETE:
-                result = p->del_key(cmd.key);
-                break;
-            default:
-                assert(!"Unknown type of operation");
+                int64_t now = stage_tracer_t::now_ns();
+                for(command_t& c : batch)
+                    c.stamp(stage_e::DEQUEUE, now);
             }
 
-            // verify result
-            if (p->is_error_code(result))
-            {
-                LOG_D << "Send client to reconnect (result code=" << result << ")" << endl;
-
-                // reconnect current client
-                //  (send it to reconnector thread)
-                m_to_reconnect.enqueue(p);
-                m_riaks.erase(m_riaks.begin());
+            // commands sent to the same node go in one pipeline
+            nodes.resize(batch.size());
+            for(size_t i = 0; i < batch.size(); i++)
+                nodes[i] = prepare(w, batch[i], stats);
 
-                // put command back to queue to repeat executing later
-                m_queue.enqueue(cmd);
-                
-                continue;
+            for(size_t i = 0; i < batch.size(); i++)
+            {
+                if (nodes[i] < 0)
+                    continue;
+
+                group.clear();
+                int node = nodes[i];
+                for(size_t j = i; j < batch.size(); j++)
+                    if (nodes[j] == node)
+                    {
+                        group.push_back(&batch[j]);
+                        nodes[j] = -1;
+                    }
+
+                execute(w, node, group, stats);
             }
-
-            // command executed successfully
-            // return result of --successfull-- GET operation
-            if (cmd.type == command_t::op_e::GET)
-                try {
-                    cmd.cb(str_result);
-                } catch (...) {}
         }
 
     } catch (std::exception const& ex) {
@@ -333,27 +1493,36 @@ void executor_t::impl_t::cmd_processor()
 void executor_t::impl_t::reconnector()
 {
     LOG_D << "Reconnector thread started" << endl;
+
+    try {
+        pin_current_thread(m_reconnector_cpus);
+    } catch (std::exception const& ex) {
+        LOG_E << "Error: " << ex.what() << endl;
+    }
     
     while ( !m_stoping.load() )
     {
-        riak_iface_ptr p;
+        reconnect_t r;
 
-        if (!m_to_reconnect.dequeue(p, 1000))
+        if (!m_to_reconnect.dequeue(r, 1000))
             continue;
 
         // there is client to reconnect
         LOG_D << "Reconnecting client... ";
 
-        if (p->reconnect())
+        if (r.riak->reconnect())
         {
             LOG_D << "Done" << endl;
-            m_from_reconnect.enqueue(p);
+            if (r.slot)
+                r.slot->state.store(inline_slot_t::FREE, std::memory_order_release);
+            else
+                r.worker->from_reconnect.enqueue(std::make_pair(r.node, r.riak));
         } else
         {
             LOG_D << "Failure" << endl;
 
             // return client back to queue
-            m_to_reconnect.enqueue(p);
+            m_to_reconnect.enqueue(r);
 
             // delay to prevent 100% of CPU load
             sleep(5);
@@ -362,3 +1531,328 @@ void executor_t::impl_t::reconnector()
 
     LOG_D << "Reconnector thread stoped" << endl;
 }
+
+void executor_t::impl_t::connector()
+{
+    LOG_D << "Connector thread started" << endl;
+
+    try {
+        pin_current_thread(m_reconnector_cpus);
+    } catch (std::exception const& ex) {
+        LOG_E << "Error: " << ex.what() << endl;
+    }
+
+    while ( !m_stoping.load() )
+    {
+        reconnect_t r;
+
+        if (!m_to_connect.dequeue(r, 1000))
+            continue;
+        if (!r.riak)
+            break;
+
+        if (!r.riak->connect(m_connect_timeout_ms))
+        {
+            LOG_W << "Failed to connect to Riak node " << m_addrs[r.node] << ", will retry later" << endl;
+            m_to_reconnect.enqueue(r);
+        }
+        else if (r.slot)
+            r.slot->state.store(inline_slot_t::FREE, std::memory_order_release);
+        else
+            r.worker->from_reconnect.enqueue(std::make_pair(r.node, r.riak));
+
+        // constructor may wait for connections
+        if (m_connecting.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(m_connect_mutex);
+            m_connect_cond.notify_all();
+        }
+    }
+
+    LOG_D << "Connector thread stoped" << endl;
+}
+
+void executor_t::impl_t::hedger()
+{
+    LOG_D << "Hedger thread started" << endl;
+
+    try {
+        pin_current_thread(m_reconnector_cpus);
+    } catch (std::exception const& ex) {
+        LOG_E << "Error: " << ex.what() << endl;
+    }
+
+    // budget is token bucket: every GET adds budget_pct/100 of token
+    const double max_tokens = 10.0;
+    double   tokens = 0;
+    uint64_t gets_seen = 0;
+
+    int64_t last_adapt = steady_us();
+    std::vector<command_t> hedges;
+
+    while ( !m_stoping.load() )
+    {
+        usleep(500);
+
+        int64_t now = steady_us();
+
+        uint64_t gets = m_gets.load(std::memory_order_relaxed);
+        tokens = std::min(max_tokens, tokens + (gets - gets_seen) * m_hedge_budget_pct.load() / 100.0);
+        gets_seen = gets;
+
+        // adaptive delay follows percentile of the last second
+        double percentile = m_hedge_percentile.load();
+        if (percentile > 0 && now - last_adapt >= 1000000)
+        {
+            histogram_t h;
+            m_get_latency.drain_to(h);
+            if (h.count() >= 100)
+                m_hedge_delay_us.store(h.percentile(percentile));
+            last_adapt = now;
+        }
+
+        int64_t delay = m_hedge_delay_us.load();
+
+        {
+            std::lock_guard<std::mutex> lock(m_hedge_mutex);
+
+            size_t keep = 0;
+            for(size_t i = 0; i < m_hedge_pending.size(); i++)
+            {
+                command_t& cmd = m_hedge_pending[i];
+                if (cmd.hedge->done.load())
+                    continue;
+
+                int64_t sent = cmd.hedge->sent_us.load();
+                if (delay == 0 || sent == 0 || now - sent < delay)
+                {
+                    // not yet
+                    if (keep != i)
+                        m_hedge_pending[keep] = std::move(cmd);
+                    keep++;
+                    continue;
+                }
+
+                // it is late: duplicate it if budget allows
+                if (tokens >= 1)
+                {
+                    tokens -= 1;
+                    hedges.push_back(std::move(cmd));
+                    hedges.back().is_hedge = true;
+                }
+            }
+            m_hedge_pending.resize(keep);
+        }
+
+        if (!hedges.empty())
+        {
+            m_hedges.fetch_add(hedges.size(), std::memory_order_relaxed);
+            // duplicates are late already, so they go ahead of ordinary work
+            m_queue.enqueue(size_t(priority_e::INTERACTIVE), hedges.begin(), hedges.end());
+            hedges.clear();
+        }
+    }
+
+    LOG_D << "Hedger thread stoped" << endl;
+}
+
+int executor_t::impl_t::prepare(worker_t *w, command_t& cmd, executor_stats_t& stats)
+{
+    // the other request of hedged pair is already answered
+    if (cmd.hedge && cmd.hedge->done.load())
+        return -1;
+
+    auto now = std::chrono::steady_clock::now();
+    stats.queue_delay[int(cmd.priority)].record(
+        std::chrono::duration_cast<std::chrono::microseconds>(now - cmd.enqueued).count());
+
+    // nobody waits for result any more
+    if (now >= cmd.deadline)
+    {
+        expire(cmd, stats);
+        return -1;
+    }
+
+    // duplicate and retry go to another node
+    int exclude = cmd.is_hedge ? cmd.hedge->node.load() : (m_retry.other_node ? cmd.failed_node : -1);
+    int node = m_balancer->pick(w->riaks, exclude);
+
+    // -1 if there is no other node for duplicate, retry goes to the same one
+    if (node < 0 && !cmd.is_hedge && exclude >= 0)
+        node = m_balancer->pick(w->riaks);
+
+    // breakers of all nodes are open
+    if (node < 0)
+        fail(cmd, stats);
+    return node;
+}
+
+void executor_t::impl_t::execute(worker_t *w, int node, std::vector<command_t*> const& cmds,
+                                 executor_stats_t& stats)
+{
+    riak_iface_ptr p = w->riaks[node];
+    auto started = std::chrono::steady_clock::now();
+
+    // the rest of time is given to the wire
+    deadline_t deadline = deadline_t::max();
+    for(command_t *cmd : cmds)
+        deadline = std::min(deadline, cmd->deadline);
+
+    if (deadline == deadline_t::max())
+        p->set_timeout(0);
+    else
+        p->set_timeout(std::chrono::duration_cast<std::chrono::milliseconds>(
+                           deadline - started).count() + 1);
+
+    for(command_t *cmd : cmds)
+    {
+        m_balancer->on_start(node);
+
+        if (cmd->hedge && !cmd->is_hedge)
+        {
+            cmd->hedge->node.store(node);
+            cmd->hedge->sent_us.store(steady_us());
+        }
+    }
+
+    if (m_tracer)
+    {
+        int64_t now = stage_tracer_t::now_ns();
+        for(command_t *cmd : cmds)
+            cmd->stamp(stage_e::SEND, now);
+    }
+
+    std::vector<std::string>& results = w->results;
+    results.resize(cmds.size());
+
+    // value of single GET with view callback stays in client's buffer
+    slice_t view;
+    if (cmds.size() == 1)
+    {
+        command_t& cmd = *cmds[0];
+        w->ops.resize(1);
+        int& result = w->ops[0].code;
+        results[0].clear();
+        switch(cmd.type)
+        {
+        case op_e::PUT:
+            result = p->put_key(cmd.key_slice(), cmd.value_slice());
+            break;
+        case op_e::GET:
+            if (cmd.view_cb)
+                result = p->get_key_view(cmd.key_slice(), &view);
+            else
+                result = p->get_key(cmd.key_slice(), &results[0]);
+            break;
+        case op_e::DELETE:
+            result = p->del_key(cmd.key_slice());
+            break;
+        default:
+            assert(!"Unknown type of operation");
+        }
+    } else
+    {
+        w->ops.resize(cmds.size());
+        for(size_t i = 0; i < cmds.size(); i++)
+        {
+            riak_iface::op_t& op = w->ops[i];
+            op.type   = riak_iface::op_t::type_e(cmds[i]->type);
+            op.key    = cmds[i]->key_slice();
+            op.value  = cmds[i]->value_slice();
+            op.result = &results[i];
+            op.code   = 0;
+            results[i].clear();
+        }
+        p->exec_pipeline(w->ops.data(), cmds.size());
+    }
+
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - started).count();
+
+    if (m_tracer)
+    {
+        int64_t now = stage_tracer_t::now_ns();
+        for(command_t *cmd : cmds)
+            cmd->stamp(stage_e::RECEIVE, now);
+    }
+
+    bool reconnecting = false;
+    for(size_t i = 0; i < cmds.size(); i++)
+    {
+        command_t& cmd = *cmds[i];
+        int result = w->ops[i].code;
+
+        bool failed = p->is_error_code(result);
+        m_balancer->on_done(node, elapsed, !failed);
+
+        // verify result
+        if (failed)
+        {
+            stats.op[int(cmd.type)].errors.fetch_add(1, std::memory_order_relaxed);
+
+            // reconnect current client
+            //  (send it to reconnector thread)
+            if (!reconnecting)
+            {
+                LOG_D << "Send client to reconnect (result code=" << result << ")" << endl;
+
+                m_to_reconnect.enqueue(reconnect_t{p, size_t(node), w, 0});
+                w->riaks[node].reset();
+                w->missing++;
+                reconnecting = true;
+            }
+
+            // put command back to queue to repeat executing later
+            //  (duplicate is just dropped, original is still there)
+            if (cmd.is_hedge)
+                continue;
+
+            cmd.attempts++;
+            cmd.failed_node = node;
+            if (!may_retry(cmd))
+            {
+                fail(cmd, stats);
+                continue;
+            }
+
+            if (cmd.hedge)
+                cmd.hedge->sent_us.store(0);
+            stats.retries.fetch_add(1, std::memory_order_relaxed);
+            m_queue.enqueue(size_t(cmd.priority), cmd);
+
+            continue;
+        }
+
+        if (cmd.hedge)
+        {
+            if (!cmd.is_hedge && m_hedge_percentile.load(std::memory_order_relaxed) > 0)
+                m_get_latency.record(elapsed);
+
+            // result of slower request is discarded
+            if (cmd.hedge->done.exchange(true))
+                continue;
+
+            if (cmd.is_hedge)
+                stats.hedge_wins.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // command executed successfully
+        op_stats_t& st = stats.op[int(cmd.type)];
+        st.ops.fetch_add(1, std::memory_order_relaxed);
+        st.latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::steady_clock::now() - cmd.enqueued).count());
+
+        // return result of --successfull-- operation
+        try {
+            if (cmd.cb)
+                cmd.cb(status_e::OK, results[i]);
+            if (cmd.view_cb)
+                cmd.view_cb(status_e::OK, cmds.size() == 1 ? view : slice_t(results[i]));
+        } catch (...) {}
+
+        if (cmd.is_sampled())
+            trace(w, cmd, cmds.size());
+
+        completed(cmd);
+    }
+}
@@ -1,31 +1,263 @@
+#ifndef CMD_EXECUTOR_HPP
+#define CMD_EXECUTOR_HPP
+
 #include "queue.hpp"
+#include "slice.hpp"
+#include "stats.hpp"
+#include "affinity.hpp"
+#include "balancer.hpp"
+#include "stage_trace.hpp"
 
 #include <vector>
+#include <chrono>
+#include <functional>
 
 typedef std::vector<std::string> strvector;
 
+// zero-copy key/value pair (see executor_t::put_batch)
+typedef std::pair<slice_t, slice_t> kv_ref_t;
+typedef std::vector<kv_ref_t>       kv_batch_t;
+
 struct command_t;
 
+// type of Riak operation
+enum class op_e {
+    PUT = 0,
+    GET,
+    DELETE,
+};
+
+// completion status of operation
+enum class status_e {
+    OK = 0,
+    TIMEOUT,    // deadline passed before operation was sent to Riak
+    ERROR,      // failed and not retried (see retry_opts_t)
+};
+
+// completion callback of asynchronous operation
+//  (called from executor thread, value is empty for PUT and DELETE)
+typedef std::function<void(status_e status, std::string const& value)> done_cb_t;
+// completion callback of GET which gets value without copying:
+//  it points into client's buffer and is valid only during the call
+typedef std::function<void(status_e status, slice_t const& value)> view_cb_t;
+
+typedef std::chrono::steady_clock::time_point deadline_t;
+
+// called when flush fence is passed (true) or executor is stopped (false),
+//  see executor_t::sync_async
+typedef std::function<void(bool done)> sync_cb_t;
+
+// lane of executor queue operation waits in
+enum class priority_e {
+    INTERACTIVE = 0,    // somebody waits for result (synchronous GET)
+    NORMAL,
+    BULK,               // background load
+};
+const char* priority_name(priority_e priority);
+
+// how synchronous GET is executed
+enum class dispatch_e {
+    QUEUED = 0,     // through queue by worker thread
+    INLINE,         // by caller thread on connection from per-node pool
+};
+const char* dispatch_name(dispatch_e dispatch);
+dispatch_e dispatch_by_name(std::string const& name);
+
+// per-operation options
+struct op_opts_t {
+    // operation which is not sent to Riak before deadline is completed
+    //  with TIMEOUT (default - executor_opts_t::timeout_ms after call)
+    deadline_t deadline;
+
+    priority_e priority;
+
+    op_opts_t(priority_e a_priority = priority_e::NORMAL): priority(a_priority) {}
+
+    static op_opts_t timeout_ms(double ms, priority_e priority = priority_e::NORMAL);
+};
+
+// called for every operation accepted by executor (see set_recorder)
+typedef std::function<void(op_e op, slice_t const& key, size_t value_size)> recorder_t;
+
+// hedging of GET requests: if GET is not answered in time,
+//  its duplicate is sent to another node and the first reply wins
+struct hedge_opts_t {
+    // fixed delay before duplicate is sent, ms (0 - hedging disabled)
+    double delay_ms;
+    // adaptive delay: percentile of recent GET latencies (0 - use fixed delay)
+    double percentile;
+    // max number of duplicates, % of GETs
+    double budget_pct;
+
+    hedge_opts_t(): delay_ms(0), percentile(0), budget_pct(5) {}
+
+    bool enabled() const { return delay_ms > 0 || percentile > 0; }
+};
+
+// what happens to operation which failed with communication error
+struct retry_opts_t {
+    // attempts of operation including the first one (0 - no limit)
+    unsigned max_attempts;
+    // retries may add at most this share of traffic, % (0 - no limit):
+    //  every new operation adds budget_pct/100 of token to bucket,
+    //  every retry takes the whole token
+    double   budget_pct;
+    // retry goes to another node if cluster has one
+    bool     other_node;
+
+    retry_opts_t(): max_attempts(0), budget_pct(0), other_node(true) {}
+};
+
+struct executor_opts_t {
+    // client library, see riak_backend_names()
+    std::string backend;
+
+    // number of command processing threads
+    //  (each thread has its own connection to every Riak node)
+    size_t workers;
+    // limit of set_workers() (0 - same as workers)
+    size_t max_workers;
+
+    // CPUs for worker threads and Reconnector thread
+    //  (threads without placement keep affinity of executor creator)
+    placement_t worker_cpus;
+    placement_t reconnector_cpus;
+
+    // how node is chosen for each command
+    balancer_t::policy_e balancer;
+
+    hedge_opts_t hedge;
+
+    retry_opts_t   retry;
+    breaker_opts_t breaker;
+
+    // connections to all nodes are made in parallel, constructor waits
+    //  for them at most connect_timeout_ms (the rest are made in background)
+    double connect_timeout_ms;
+    // connect worker's clients when it gets the first command
+    bool   lazy_connect;
+
+    // default time limit of operation, ms (0 - no limit)
+    double timeout_ms;
+
+    // share of dequeues every priority lane gets when all of them are busy
+    //  (indexed by priority_e)
+    std::vector<unsigned> lane_weights;
+
+    // commands worker takes from queue at once; ones for the same node
+    //  are sent as pipeline (see riak_iface::exec_pipeline)
+    size_t pipeline;
+
+    // one of this number of operations gets timestamps of its stages
+    //  (see stage_tracer), 0 - no tracing
+    size_t trace_every;
+
+    // synchronous GETs are executed by caller thread if INLINE,
+    //  pool has inline_conns connections to every node (when all of them
+    //  are busy or down, GET goes through queue)
+    dispatch_e dispatch;
+    size_t     inline_conns;
+
+    executor_opts_t(): backend("riack"), workers(1), max_workers(0), balancer(balancer_t::policy_e::FIRST),
+                       connect_timeout_ms(1000), lazy_connect(false), timeout_ms(0),
+                       lane_weights({ 8, 4, 1 }), pipeline(1), trace_every(0),
+                       dispatch(dispatch_e::QUEUED), inline_conns(4) {}
+};
+
 class executor_t {
-public: 
-    executor_t(strvector const& addrlist);
+public:
+    executor_t(strvector const& addrlist, executor_opts_t const& opts = executor_opts_t());
     ~executor_t();
 
-    bool put_key(std::string const& key, std::string const& value);
-    std::string get_key(std::string const& key);
-    bool del_key(std::string const& key);
+    // synchronous GET returns empty string on timeout
+    //  and goes to INTERACTIVE lane by default
+    bool put_key(std::string const& key, std::string const& value, op_opts_t const& opts = op_opts_t());
+    std::string get_key(std::string const& key, op_opts_t const& opts = op_opts_t(priority_e::INTERACTIVE));
+    bool del_key(std::string const& key, op_opts_t const& opts = op_opts_t());
+    // synchronous GET into caller's buffer (its capacity is reused),
+    //  false on timeout
+    bool get_key(std::string const& key, std::string *value,
+                 op_opts_t const& opts = op_opts_t(priority_e::INTERACTIVE));
+
+    // asynchronous versions of operations
+    bool put_key(std::string const& key, std::string const& value, done_cb_t const& cb,
+                 op_opts_t const& opts = op_opts_t());
+    bool get_key(std::string const& key, done_cb_t const& cb, op_opts_t const& opts = op_opts_t());
+    bool del_key(std::string const& key, done_cb_t const& cb, op_opts_t const& opts = op_opts_t());
 
-    // pauses client until executor finished its queue
+    // zero-copy PUT: key and value are not copied,
+    //  memory must stay valid until command is executed (e.g. until sync())
+    bool put_key_ref(slice_t const& key, slice_t const& value, op_opts_t const& opts = op_opts_t());
+    // zero-copy GET: key is not copied (it must stay valid until callback,
+    //  so such GET is never hedged), value is passed as view
+    bool get_key_ref(slice_t const& key, view_cb_t const& cb, op_opts_t const& opts = op_opts_t());
+    // group of zero-copy PUTs enqueued in one go (BULK lane by default),
+    //  'cb' is called for every PUT of batch
+    bool put_batch(kv_batch_t const& batch, op_opts_t const& opts = op_opts_t(priority_e::BULK));
+    bool put_batch(kv_batch_t const& batch, done_cb_t const& cb,
+                   op_opts_t const& opts = op_opts_t(priority_e::BULK));
+
+    // number of commands waiting in queue
+    size_t pending() const;
+    size_t pending(priority_e priority) const;
+
+    // sets hook which sees every operation (e.g. to write trace)
+    //  must be set before any operation is issued
+    void set_recorder(recorder_t const& recorder);
+
+    // counters and latencies of executed operations (see stats_source_t)
+    void collect_stats(executor_stats_t& dst);
+
+    // sampled stage timestamps (see executor_opts_t::trace_every),
+    //  0 if tracing is off. Samples are collected by collect_stats() too
+    stage_tracer_t* stage_tracer() const;
+
+    // per-node selection statistics
+    struct node_info_t {
+        std::string addr;
+        uint64_t    selected;
+        uint64_t    failures;
+        size_t      outstanding;
+        double      ewma_us;
+        const char *breaker;        // state of circuit breaker
+        uint64_t    breaker_opened;
+    };
+    std::vector<node_info_t> nodes() const;
+
+    // settings which may be changed while executor runs
+    //  number of active workers (1..max_workers), returns the number set
+    size_t workers() const;
+    size_t set_workers(size_t count);
+
+    hedge_opts_t hedge() const;
+    void set_hedge(hedge_opts_t const& opts);
+
+    // default time limit of operation, ms (0 - no limit)
+    double timeout_ms() const;
+    void set_timeout(double timeout_ms);
+
+    // placement of executor threads on CPUs, e.g. "worker0=2(node0) reconnector=any"
+    std::string layout() const;
+
+    // flush fence: pauses client until every command issued before the call
+    //  is completed (worker threads keep running)
     void sync();
-    
+    // the same with time limit, false on timeout or if executor is stopped
+    bool sync_for(double timeout_ms);
+    // does not wait: cb is called when fence is passed (from executor
+    //  thread, or right away if there is nothing to wait for)
+    void sync_async(sync_cb_t const& cb);
+
     // true - stop right now (ignore commands in queue)
     // false - stop when done (queue is empty)
     void stop(bool stop_now);
 
     // true is executor is stoped
     bool is_stoped() const;
-    
+
 private:
     struct impl_t;
     impl_t *m_impl;
 };
+
+#endif //CMD_EXECUTOR_HPP
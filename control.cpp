@@ -0,0 +1,239 @@
+#include "control.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "exception.hpp"
+#include "logger.hpp"
+
+// max length of request line
+static const size_t MAX_LINE = 4096;
+
+struct control_t::impl_t {
+    std::string path;
+    int         listen_fd;
+
+    struct command_t {
+        std::string usage;
+        handler_t   handler;
+    };
+    std::map<std::string, command_t> commands;
+
+    struct client_t {
+        int         fd;
+        std::string in;
+    };
+    std::vector<client_t> clients;
+
+    std::thread       thread;
+    std::atomic<bool> running;
+
+    void worker();
+    // false if client must be disconnected
+    bool serve(client_t& c);
+    void execute(std::string const& line, std::string& out, bool *quit);
+};
+
+control_t::control_t(std::string const& path)
+    : m_impl(new impl_t)
+{
+    m_impl->path = path;
+    m_impl->running.store(false);
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+    {
+        delete m_impl;
+        throw Exception("Invalid control socket path <" + path + ">");
+    }
+    strcpy(addr.sun_path, path.c_str());
+
+    // socket left by previous run
+    unlink(path.c_str());
+
+    m_impl->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_impl->listen_fd < 0
+        || bind(m_impl->listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0
+        || listen(m_impl->listen_fd, 8) != 0)
+    {
+        std::string err = strerror(errno);
+        if (m_impl->listen_fd >= 0)
+            close(m_impl->listen_fd);
+        delete m_impl;
+        throw Exception("Cannot create control socket <" + path + ">: " + err);
+    }
+}
+
+control_t::~control_t()
+{
+    stop();
+
+    close(m_impl->listen_fd);
+    unlink(m_impl->path.c_str());
+
+    delete m_impl;
+}
+
+void control_t::add(std::string const& name, std::string const& usage, handler_t const& handler)
+{
+    m_impl->commands[name] = impl_t::command_t{ usage, handler };
+}
+
+void control_t::start()
+{
+    m_impl->running.store(true);
+    m_impl->thread = std::thread(&impl_t::worker, m_impl);
+}
+
+void control_t::stop()
+{
+    if (!m_impl->running.exchange(false))
+        return;
+    m_impl->thread.join();
+
+    for(auto& c : m_impl->clients)
+        close(c.fd);
+    m_impl->clients.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation goes here
+void control_t::impl_t::worker()
+{
+    LOG_D << "Control thread started" << endl;
+
+    std::vector<pollfd> fds;
+    while (running.load())
+    {
+        fds.clear();
+        fds.push_back(pollfd{ listen_fd, POLLIN, 0 });
+        for(auto& c : clients)
+            fds.push_back(pollfd{ c.fd, POLLIN, 0 });
+
+        // timeout lets stop() be noticed
+        if (poll(fds.data(), fds.size(), 200) <= 0)
+            continue;
+
+        // clients are checked first: accept() changes the list
+        size_t keep = 0;
+        for(size_t i = 0; i < clients.size(); i++)
+        {
+            if ((fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) && !serve(clients[i]))
+            {
+                close(clients[i].fd);
+                continue;
+            }
+            if (keep != i)
+                clients[keep] = std::move(clients[i]);
+            keep++;
+        }
+        clients.resize(keep);
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept(listen_fd, 0, 0);
+            if (fd >= 0)
+                clients.push_back(client_t{ fd, std::string() });
+        }
+    }
+
+    LOG_D << "Control thread stoped" << endl;
+}
+
+bool control_t::impl_t::serve(client_t& c)
+{
+    char buf[1024];
+    ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+    if (n <= 0)
+        return n < 0 && errno == EINTR;
+    c.in.append(buf, n);
+
+    bool quit = false;
+    std::string out;
+    for(size_t eol; !quit && (eol = c.in.find('\n')) != std::string::npos; )
+    {
+        std::string line = c.in.substr(0, eol);
+        c.in.erase(0, eol + 1);
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        execute(line, out, &quit);
+    }
+
+    if (c.in.size() > MAX_LINE)
+    {
+        out += "ERROR request is too long\n";
+        quit = true;
+    }
+
+    for(size_t sent = 0; sent < out.size(); )
+    {
+        n = send(c.fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return false;
+        }
+        sent += n;
+    }
+
+    return !quit;
+}
+
+void control_t::impl_t::execute(std::string const& line, std::string& out, bool *quit)
+{
+    std::vector<std::string> args;
+    for(size_t pos = 0; pos < line.size(); )
+    {
+        size_t begin = line.find_first_not_of(" \t", pos);
+        if (begin == std::string::npos)
+            break;
+        size_t end = line.find_first_of(" \t", begin);
+        if (end == std::string::npos)
+            end = line.size();
+        args.push_back(line.substr(begin, end - begin));
+        pos = end;
+    }
+
+    if (args.empty())
+        return;
+
+    if (args[0] == "help")
+    {
+        for(auto const& c : commands)
+            out += "  " + c.second.usage + "\n";
+        out += "  quit\nOK\n";
+        return;
+    }
+    if (args[0] == "quit")
+    {
+        out += "OK\n";
+        *quit = true;
+        return;
+    }
+
+    auto it = commands.find(args[0]);
+    if (it == commands.end())
+    {
+        out += "ERROR unknown command <" + args[0] + ">, see help\n";
+        return;
+    }
+
+    try {
+        it->second.handler(args, out);
+        out += "OK\n";
+        LOG_D << "Control: " << line << endl;
+    } catch (std::exception const& ex) {
+        out += std::string("ERROR ") + ex.what() + "\n";
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef CONTROL_HPP
+#define CONTROL_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+
+// Control channel of running tester: Unix-domain socket with line protocol.
+//  Request is one line "COMMAND [ARGS...]", reply is zero or more lines
+//  of output followed by "OK" or "ERROR <message>" line, e.g.
+//      echo "set rate 5000" | nc -U /tmp/riak_test.sock
+//  Commands are served by separate thread, handlers must be thread-safe.
+class control_t {
+public:
+    // appends reply to 'out', throws Exception if request is wrong
+    //  (args[0] is command name)
+    typedef std::function<void(std::vector<std::string> const& args, std::string& out)> handler_t;
+
+    control_t(std::string const& path);
+    ~control_t();
+
+    // must be called before start()
+    void add(std::string const& name, std::string const& usage, handler_t const& handler);
+
+    void start();
+    void stop();
+
+private:
+    struct impl_t;
+    impl_t *m_impl;
+};
+
+#endif //CONTROL_HPP
@@ -0,0 +1,151 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free latency histogram with log-linear buckets (~3% precision).
+//  Values are in microseconds, record() can be called from any thread.
+//  Object has fixed size and no pointers (can be placed into shared memory).
+class histogram_t {
+public:
+    enum {
+        SUB_BITS  = 5,
+        SUB_COUNT = 1 << SUB_BITS,
+        MAX_BITS  = 37,                 // values are clamped to 2^37 us (~38 hours)
+        BUCKETS   = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT
+    };
+
+    histogram_t() { reset(); }
+
+    void record(uint64_t value)
+    {
+        if (value >= (uint64_t(1) << MAX_BITS))
+            value = (uint64_t(1) << MAX_BITS) - 1;
+
+        m_counts[index_of(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t cur = m_max.load(std::memory_order_relaxed);
+        while (value > cur
+               && !m_max.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+            ;
+    }
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+    double mean() const
+    {
+        uint64_t n = count();
+        return n ? double(m_sum.load(std::memory_order_relaxed)) / n : 0.0;
+    }
+
+    // p is in range [0, 100]; returns upper bound of bucket holding percentile
+    uint64_t percentile(double p) const
+    {
+        uint64_t n = count();
+        if (n == 0)
+            return 0;
+
+        uint64_t rank = uint64_t(p / 100.0 * n + 0.5);
+        if (rank == 0)
+            rank = 1;
+
+        uint64_t seen = 0;
+        for(int i = 0; i < BUCKETS; i++)
+        {
+            seen += m_counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                uint64_t v = upper_bound_of(i);
+                return v < max() ? v : max();
+            }
+        }
+
+        return max();
+    }
+
+    void merge(histogram_t const& other)
+    {
+        for(int i = 0; i < BUCKETS; i++)
+        {
+            uint64_t c = other.m_counts[i].load(std::memory_order_relaxed);
+            if (c)
+                m_counts[i].fetch_add(c, std::memory_order_relaxed);
+        }
+        m_count.fetch_add(other.count(), std::memory_order_relaxed);
+        m_sum.fetch_add(other.m_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+        uint64_t omax = other.max(), cur = max();
+        while (omax > cur
+               && !m_max.compare_exchange_weak(cur, omax, std::memory_order_relaxed))
+            ;
+    }
+
+    // moves collected data to 'dst' (which is merged with it)
+    //  while other threads keep recording into this histogram
+    void drain_to(histogram_t& dst)
+    {
+        uint64_t total = 0;
+        for(int i = 0; i < BUCKETS; i++)
+        {
+            uint64_t c = m_counts[i].exchange(0, std::memory_order_relaxed);
+            if (c)
+            {
+                dst.m_counts[i].fetch_add(c, std::memory_order_relaxed);
+                total += c;
+            }
+        }
+        dst.m_count.fetch_add(total, std::memory_order_relaxed);
+        m_count.fetch_sub(total, std::memory_order_relaxed);
+
+        uint64_t sum = m_sum.exchange(0, std::memory_order_relaxed);
+        dst.m_sum.fetch_add(sum, std::memory_order_relaxed);
+
+        uint64_t omax = m_max.exchange(0, std::memory_order_relaxed), cur = dst.max();
+        while (omax > cur
+               && !dst.m_max.compare_exchange_weak(cur, omax, std::memory_order_relaxed))
+            ;
+    }
+
+    void reset()
+    {
+        for(int i = 0; i < BUCKETS; i++)
+            m_counts[i].store(0, std::memory_order_relaxed);
+        m_count.store(0, std::memory_order_relaxed);
+        m_sum.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    histogram_t(histogram_t const&);
+    histogram_t& operator=(histogram_t const&);
+
+    static int index_of(uint64_t v)
+    {
+        if (v < 2 * SUB_COUNT)
+            return int(v);
+
+        int msb = 63 - __builtin_clzll(v);
+        int e = msb - SUB_BITS;
+        return (e + 1) * SUB_COUNT + int(v >> e) - SUB_COUNT;
+    }
+
+    static uint64_t upper_bound_of(int idx)
+    {
+        if (idx < 2 * SUB_COUNT)
+            return idx;
+
+        int e = idx / SUB_COUNT - 1;
+        uint64_t sub = idx % SUB_COUNT + SUB_COUNT;
+        return ((sub + 1) << e) - 1;
+    }
+
+    std::atomic<uint64_t> m_counts[BUCKETS];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+};
+
+#endif //HISTOGRAM_HPP
@@ -0,0 +1,244 @@
+#include "http_server.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <strings.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "exception.hpp"
+#include "logger.hpp"
+#include "utils.hpp"
+#include "riak_null.hpp"
+
+static const char KEYS[] = "/keys/";
+
+static const size_t MAX_HEADER = 64 * 1024;
+
+struct http_server_t::impl_t {
+    int listen_fd;
+
+    // serves one client connection
+    static void session(int fd);
+    // handles request and appends response to 'out'
+    static bool handle(slice_t const& method, slice_t const& path, slice_t const& body,
+                       std::string& out);
+};
+
+// %XX sequences of URL path
+static std::string url_decode(const char *p, const char *end)
+{
+    std::string res;
+    res.reserve(end - p);
+    for(; p < end; p++)
+    {
+        if (*p == '%' && end - p >= 3 && isxdigit(p[1]) && isxdigit(p[2]))
+        {
+            char hex[3] = { p[1], p[2], 0 };
+            res += char(strtol(hex, 0, 16));
+            p += 2;
+        } else
+            res += *p;
+    }
+    return res;
+}
+
+static void add_response(std::string& out, const char *status, slice_t const& body = slice_t())
+{
+    out.append("HTTP/1.1 ");
+    out.append(status);
+    out.append("\r\nContent-Type: text/plain\r\nContent-Length: ");
+    out.append(std::to_string(body.size));
+    out.append("\r\n\r\n");
+    out.append(body.data, body.size);
+}
+
+http_server_t::http_server_t(std::string const& addr)
+    : m_impl(new impl_t)
+{
+    std::string host;
+    int port;
+    if (!validate_address(addr, &host, &port))
+        throw Exception("Invalid address <" + addr + ">");
+
+    addrinfo hints, *res = 0;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res)
+    {
+        delete m_impl;
+        throw Exception("Cannot resolve <" + addr + ">");
+    }
+
+    m_impl->listen_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+
+    int one = 1;
+    if (m_impl->listen_fd < 0
+        || setsockopt(m_impl->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0
+        || bind(m_impl->listen_fd, res->ai_addr, res->ai_addrlen) != 0
+        || listen(m_impl->listen_fd, 128) != 0)
+    {
+        std::string err = strerror(errno);
+        freeaddrinfo(res);
+        if (m_impl->listen_fd >= 0)
+            close(m_impl->listen_fd);
+        delete m_impl;
+        throw Exception("Cannot listen on <" + addr + ">: " + err);
+    }
+    freeaddrinfo(res);
+}
+
+http_server_t::~http_server_t()
+{
+    close(m_impl->listen_fd);
+    delete m_impl;
+}
+
+void http_server_t::run()
+{
+    for(;;)
+    {
+        int fd = accept(m_impl->listen_fd, 0, 0);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            throw Exception(std::string("accept failed: ") + strerror(errno));
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::thread(impl_t::session, fd).detach();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation goes here
+void http_server_t::impl_t::session(int fd)
+{
+    std::string in, out;
+    std::vector<char> buf(64 * 1024);
+
+    for(bool open = true; open; )
+    {
+        ssize_t n = recv(fd, buf.data(), buf.size(), 0);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        in.append(buf.data(), n);
+
+        // all complete requests are answered with one write
+        size_t pos = 0;
+        out.clear();
+        for(;;)
+        {
+            size_t hdr_end = in.find("\r\n\r\n", pos);
+            if (hdr_end == std::string::npos)
+            {
+                if (in.size() - pos > MAX_HEADER)
+                    open = false;
+                break;
+            }
+            hdr_end += 4;
+
+            // request line: METHOD PATH HTTP/1.1
+            const char *p   = in.data() + pos;
+            const char *end = in.data() + hdr_end;
+            const char *sp1 = (const char*)memchr(p, ' ', end - p);
+            const char *sp2 = sp1 ? (const char*)memchr(sp1 + 1, ' ', end - sp1 - 1) : 0;
+            if (!sp2)
+            {
+                open = false;
+                break;
+            }
+
+            size_t length = 0;
+            for(const char *h = (const char*)memchr(p, '\n', end - p) + 1; h < end - 2; )
+            {
+                const char *eol = (const char*)memchr(h, '\n', end - h);
+                if (strncasecmp(h, "Content-Length:", 15) == 0)
+                    length = strtoull(h + 15, 0, 10);
+                else
+                if (strncasecmp(h, "Connection:", 11) == 0 && memmem(h, eol - h, "close", 5))
+                    open = false;
+                h = eol + 1;
+            }
+
+            if (in.size() < hdr_end + length)
+                break;      // body is not received yet
+
+            handle(slice_t(p, sp1 - p), slice_t(sp1 + 1, sp2 - sp1 - 1),
+                   slice_t(in.data() + hdr_end, length), out);
+            pos = hdr_end + length;
+        }
+        in.erase(0, pos);
+
+        for(size_t sent = 0; sent < out.size(); )
+        {
+            n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                if (n < 0 && errno == EINTR)
+                    continue;
+                open = false;
+                break;
+            }
+            sent += n;
+        }
+    }
+
+    close(fd);
+}
+
+bool http_server_t::impl_t::handle(slice_t const& method, slice_t const& path, slice_t const& body,
+                                   std::string& out)
+{
+    // /buckets/<bucket>/keys/<key> (bucket is ignored)
+    const char *k = (const char*)memmem(path.data, path.size, KEYS, sizeof(KEYS) - 1);
+    if (!k)
+    {
+        add_response(out, "400 Bad Request");
+        return false;
+    }
+    k += sizeof(KEYS) - 1;
+    std::string key = url_decode(k, path.data + path.size);
+
+    riak_null storage;
+    std::string m = method.str();
+    if (m == "GET")
+    {
+        std::string value;
+        storage.get_key(key, &value);
+        if (value.empty())
+            add_response(out, "404 Object Not Found", "not found\n");
+        else
+            add_response(out, "200 OK", value);
+    } else
+    if (m == "PUT" || m == "POST")
+    {
+        storage.put_key(key, body);
+        add_response(out, "204 No Content");
+    } else
+    if (m == "DELETE")
+    {
+        storage.del_key(key);
+        add_response(out, "204 No Content");
+    } else
+    {
+        add_response(out, "405 Method Not Allowed");
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,24 @@
+#ifndef HTTP_SERVER_HPP
+#define HTTP_SERVER_HPP
+
+#include <string>
+
+// Stand-in for Riak HTTP API: keep-alive HTTP/1.1 server which keeps values
+//  in process memory ("null" backend storage). Understands pipelined
+//  GET/PUT/DELETE of /buckets/<bucket>/keys/<key>, one thread per connection.
+//  Lets "http" backend be tested and benchmarked without Riak.
+class http_server_t {
+public:
+    // addr is "IP:port" to listen on
+    http_server_t(std::string const& addr);
+    ~http_server_t();
+
+    // accepts connections until process is stopped
+    void run();
+
+private:
+    struct impl_t;
+    impl_t *m_impl;
+};
+
+#endif //HTTP_SERVER_HPP
@@ -0,0 +1,179 @@
+#ifndef __LANE_QUEUE_HPP__
+#define __LANE_QUEUE_HPP__
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <chrono>
+
+// Queue with several FIFO lanes (e.g. priorities).
+//  Non-empty lanes are served by smooth weighted round-robin:
+//  lane with weight W gets W/sum(W) of dequeues, so no lane starves.
+template <class T>
+class lane_queue
+{
+public:
+    lane_queue(std::vector<unsigned> const& weights);
+
+    void enqueue(size_t lane, const T & cdata);
+    // enqueues range of elements under single lock
+    template <class It>
+    void enqueue(size_t lane, It first, It last);
+
+    // returns false if nothing was dequeued in 'timeout_ms'
+    //  'lane' receives lane element was taken from
+    bool dequeue(T & cdata, const int timeout_ms, size_t *lane = 0);
+    // does not wait at all (even zero timeout costs timer wake-up)
+    bool try_dequeue(T & cdata, size_t *lane = 0);
+    // waits until queue is not empty, returns false on timeout
+    bool wait(const int timeout_ms) const;
+
+    size_t size() const;
+    size_t size(size_t lane) const;
+    size_t lanes() const { return m_lanes.size(); }
+
+private:
+    struct lane_t {
+        std::deque<T> items;
+        int           weight;
+        int           credit;
+    };
+
+    // picks lane to serve next (at least one lane must be non-empty)
+    size_t next_lane();
+
+    std::vector<lane_t> m_lanes;
+    size_t m_size;
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_cond_var;
+};
+
+template <typename T>
+lane_queue<T>::lane_queue(std::vector<unsigned> const& weights)
+    : m_lanes(weights.size())
+    , m_size(0)
+{
+    for(size_t i = 0; i < weights.size(); i++)
+    {
+        m_lanes[i].weight = weights[i] ? weights[i] : 1;
+        m_lanes[i].credit = 0;
+    }
+}
+
+template <typename T>
+void lane_queue<T>::enqueue(size_t lane, const T & cdata)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_lanes[lane].items.push_back(cdata);
+        m_size++;
+    }
+
+    m_cond_var.notify_one();
+}
+
+template <typename T>
+template <class It>
+void lane_queue<T>::enqueue(size_t lane, It first, It last)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::deque<T>& items = m_lanes[lane].items;
+
+        size_t before = items.size();
+        items.insert(items.end(), first, last);
+        m_size += items.size() - before;
+    }
+
+    m_cond_var.notify_all();
+}
+
+template <typename T>
+bool lane_queue<T>::dequeue(T & cdata, const int timeout_ms, size_t *lane)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (!m_cond_var.wait_until(lock,
+            std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms),
+            [this] { return m_size != 0; }))
+        return false;
+
+    size_t i = next_lane();
+    cdata = m_lanes[i].items.front();
+    m_lanes[i].items.pop_front();
+    m_size--;
+
+    if (lane)
+        *lane = i;
+    return true;
+}
+
+template <typename T>
+bool lane_queue<T>::try_dequeue(T & cdata, size_t *lane)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_size == 0)
+        return false;
+
+    size_t i = next_lane();
+    cdata = m_lanes[i].items.front();
+    m_lanes[i].items.pop_front();
+    m_size--;
+
+    if (lane)
+        *lane = i;
+    return true;
+}
+
+template <typename T>
+bool lane_queue<T>::wait(const int timeout_ms) const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    return m_cond_var.wait_until(lock,
+            std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms),
+            [this] { return m_size != 0; });
+}
+
+template <typename T>
+size_t lane_queue<T>::next_lane()
+{
+    // every non-empty lane earns its weight, the chosen one pays the total
+    //  (empty lanes do not accumulate credit while they are idle)
+    int total = 0;
+    size_t best = m_lanes.size();
+    for(size_t i = 0; i < m_lanes.size(); i++)
+    {
+        lane_t& l = m_lanes[i];
+        if (l.items.empty())
+        {
+            l.credit = 0;
+            continue;
+        }
+
+        l.credit += l.weight;
+        total += l.weight;
+        if (best == m_lanes.size() || l.credit > m_lanes[best].credit)
+            best = i;
+    }
+
+    m_lanes[best].credit -= total;
+    return best;
+}
+
+template <typename T>
+size_t lane_queue<T>::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_size;
+}
+
+template <typename T>
+size_t lane_queue<T>::size(size_t lane) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lanes[lane].items.size();
+}
+
+#endif // __LANE_QUEUE_HPP__
@@ -0,0 +1,337 @@
+#include "loader.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "exception.hpp"
+#include "logger.hpp"
+#include "cmd_executor.hpp"
+
+struct loader_t::impl_t {
+    std::string  path;
+    format_e     format;
+
+    int          fd;
+    const char  *data;
+    size_t       size;
+
+    placement_t  placement;
+
+    // progress counters, updated once per batch
+    std::atomic<size_t> records;
+    std::atomic<size_t> bytes;
+    std::atomic<size_t> skipped;
+
+    // completions of PUTs
+    std::atomic<size_t> failed;
+    done_cb_t           on_done;
+
+    // offsets of records which start each range
+    std::vector<size_t> split(size_t parts) const;
+
+    void parse_range(executor_t& executor, size_t from, size_t to, size_t batch_size, size_t max_pending);
+
+    // parses one record at 'pos', moves 'pos' to the next one
+    //  returns false if the rest of range has no complete record
+    bool next_tsv(size_t& pos, size_t to, kv_ref_t *kv) const;
+    bool next_bin(size_t& pos, size_t to, kv_ref_t *kv) const;
+};
+
+static uint32_t read_le32(const char *p)
+{
+    const unsigned char *u = reinterpret_cast<const unsigned char*>(p);
+    return uint32_t(u[0]) | (uint32_t(u[1]) << 8) | (uint32_t(u[2]) << 16) | (uint32_t(u[3]) << 24);
+}
+
+loader_t::loader_t(std::string const& path, format_e format)
+    : m_impl(new impl_t)
+{
+    m_impl->path   = path;
+    m_impl->format = format;
+    m_impl->data   = 0;
+    m_impl->size   = 0;
+
+    m_impl->fd = open(path.c_str(), O_RDONLY);
+    if (m_impl->fd < 0)
+    {
+        delete m_impl;
+        throw Exception("Failed to open <" + path + ">: " + strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(m_impl->fd, &st) != 0)
+    {
+        close(m_impl->fd);
+        delete m_impl;
+        throw Exception("Failed to stat <" + path + ">: " + strerror(errno));
+    }
+    m_impl->size = st.st_size;
+
+    // mmap() does not accept empty files
+    if (m_impl->size == 0)
+        return;
+
+    void *p = mmap(0, m_impl->size, PROT_READ, MAP_PRIVATE, m_impl->fd, 0);
+    if (p == MAP_FAILED)
+    {
+        close(m_impl->fd);
+        delete m_impl;
+        throw Exception("Failed to map <" + path + ">: " + strerror(errno));
+    }
+
+    // each parser reads its range front to back
+    madvise(p, m_impl->size, MADV_SEQUENTIAL);
+
+    m_impl->data = static_cast<const char*>(p);
+}
+
+loader_t::~loader_t()
+{
+    if (m_impl->data)
+        munmap(const_cast<char*>(m_impl->data), m_impl->size);
+    close(m_impl->fd);
+
+    delete m_impl;
+}
+
+void loader_t::set_placement(placement_t const& placement)
+{
+    m_impl->placement = placement;
+}
+
+loader_t::format_e loader_t::format_by_name(std::string const& name)
+{
+    if (strcasecmp(name.c_str(), "TSV") == 0)
+        return format_e::TSV;
+    if (strcasecmp(name.c_str(), "BIN") == 0)
+        return format_e::BIN;
+
+    throw Exception("Unknown file format <" + name + ">");
+}
+
+loader_t::result_t loader_t::run(executor_t& executor, size_t threads, size_t batch_size)
+{
+    if (threads == 0)
+        threads = 1;
+    if (batch_size == 0)
+        batch_size = 1;
+
+    m_impl->records.store(0);
+    m_impl->bytes.store(0);
+    m_impl->skipped.store(0);
+    m_impl->failed.store(0);
+
+    impl_t *impl = m_impl;
+    m_impl->on_done = [impl] (status_e status, std::string const&)
+        {
+            if (status != status_e::OK)
+                impl->failed.fetch_add(1, std::memory_order_relaxed);
+        };
+
+    // limit memory used by the executor queue
+    size_t max_pending = batch_size * threads * 4;
+
+    std::vector<size_t> bounds = m_impl->split(threads);
+
+    printf("Loading %s: %zu bytes, %zu ranges\n",
+           m_impl->path.c_str(), m_impl->size, bounds.size() - 1);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> parsers;
+    for(size_t i = 0; i + 1 < bounds.size(); i++)
+        parsers.push_back(std::thread([this, &executor, &bounds, i, batch_size, max_pending] ()
+            {
+                try {
+                    pin_current_thread(m_impl->placement.cpus_for(i));
+                } catch (std::exception const& ex) {
+                    LOG_E << "Error: " << ex.what() << endl;
+                }
+                m_impl->parse_range(executor, bounds[i], bounds[i + 1], batch_size, max_pending);
+            }));
+
+    // progress reporting
+    std::atomic_bool parsing(true);
+    std::thread progress([this, &parsing, start] ()
+        {
+            size_t last_records = 0, last_bytes = 0;
+            while (parsing.load())
+            {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+
+                size_t records = m_impl->records.load();
+                size_t bytes   = m_impl->bytes.load();
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                printf("  %6.1fs: %zu records (%5.1f%%), %zu rec/s, %.1f MB/s\n",
+                       elapsed, records,
+                       m_impl->size ? 100.0 * bytes / m_impl->size : 100.0,
+                       records - last_records,
+                       (bytes - last_bytes) / 1048576.0);
+                fflush(stdout);
+
+                last_records = records;
+                last_bytes   = bytes;
+            }
+        });
+
+    for(std::thread& t : parsers)
+        t.join();
+
+    // views into the mapping must stay valid until everything is written
+    executor.sync();
+
+    result_t r;
+    r.records = m_impl->records.load();
+    r.bytes   = m_impl->bytes.load();
+    r.skipped = m_impl->skipped.load();
+    r.failed  = m_impl->failed.load();
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    parsing.store(false);
+    progress.join();
+
+    return r;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation goes here
+std::vector<size_t> loader_t::impl_t::split(size_t parts) const
+{
+    std::vector<size_t> bounds(1, 0);
+
+    if (format == format_e::TSV)
+    {
+        // move each boundary to the beginning of the next line
+        for(size_t i = 1; i < parts; i++)
+        {
+            size_t pos = std::max(size * i / parts, bounds.back());
+            const char *nl = pos < size ? static_cast<const char*>(memchr(data + pos, '\n', size - pos)) : 0;
+            pos = nl ? nl - data + 1 : size;
+
+            if (pos > bounds.back() && pos < size)
+                bounds.push_back(pos);
+        }
+    } else
+    {
+        // records have no separators: walk over headers to find boundaries
+        size_t pos = 0;
+        for(size_t i = 1; i < parts && pos < size; i++)
+        {
+            size_t target = size * i / parts;
+            while (pos < target && pos + 8 <= size)
+                pos += 8 + size_t(read_le32(data + pos)) + read_le32(data + pos + 4);
+
+            if (pos > bounds.back() && pos < size)
+                bounds.push_back(pos);
+        }
+    }
+
+    bounds.push_back(size);
+    return bounds;
+}
+
+bool loader_t::impl_t::next_tsv(size_t& pos, size_t to, kv_ref_t *kv) const
+{
+    if (pos >= to)
+        return false;
+
+    const char *line = data + pos;
+    const char *nl   = static_cast<const char*>(memchr(line, '\n', to - pos));
+    size_t len = nl ? nl - line : to - pos;
+
+    pos = nl ? pos + len + 1 : to;
+
+    // tolerate Windows line endings
+    if (len > 0 && line[len - 1] == '\r')
+        len--;
+
+    const char *tab = static_cast<const char*>(memchr(line, '\t', len));
+    if (!tab)
+    {
+        kv->first = kv->second = slice_t();
+        return true;
+    }
+
+    kv->first  = slice_t(line, tab - line);
+    kv->second = slice_t(tab + 1, line + len - tab - 1);
+    return true;
+}
+
+bool loader_t::impl_t::next_bin(size_t& pos, size_t to, kv_ref_t *kv) const
+{
+    if (pos + 8 > to)
+        return false;
+
+    size_t klen = read_le32(data + pos);
+    size_t vlen = read_le32(data + pos + 4);
+
+    // truncated record
+    if (pos + 8 + klen + vlen > to)
+        return false;
+
+    kv->first  = slice_t(data + pos + 8, klen);
+    kv->second = slice_t(data + pos + 8 + klen, vlen);
+
+    pos += 8 + klen + vlen;
+    return true;
+}
+
+void loader_t::impl_t::parse_range(executor_t& executor, size_t from, size_t to,
+                                   size_t batch_size, size_t max_pending)
+{
+    kv_batch_t batch;
+    batch.reserve(batch_size);
+
+    size_t pos = from, batch_start = from, bad = 0;
+    kv_ref_t kv;
+
+    for(;;)
+    {
+        bool more = (format == format_e::TSV) ? next_tsv(pos, to, &kv) : next_bin(pos, to, &kv);
+
+        if (more)
+        {
+            // Riak does not accept empty keys or values
+            if (kv.first.empty() || kv.second.empty())
+                bad++;
+            else
+                batch.push_back(kv);
+        } else
+        if (pos < to)
+            bad++;      // truncated record at the end of range
+
+        if (batch.size() < batch_size && more)
+            continue;
+
+        // backpressure: don't let the queue grow without limits
+        while (executor.pending() > max_pending)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        if (!batch.empty())
+            executor.put_batch(batch, on_done);
+
+        records.fetch_add(batch.size());
+        bytes.fetch_add((more ? pos : to) - batch_start);
+        skipped.fetch_add(bad);
+
+        batch.clear();
+        batch_start = pos;
+        bad = 0;
+
+        if (!more)
+            break;
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef LOADER_HPP
+#define LOADER_HPP
+
+#include <string>
+
+#include "affinity.hpp"
+
+class executor_t;
+
+// Bulk loader: streams key/value records from memory-mapped file to executor.
+//  Records are never copied - executor gets views into the mapped file.
+//
+// Supported formats:
+//  TSV - one "key<TAB>value" record per line
+//  BIN - <uint32 key length><uint32 value length><key><value>, little-endian
+class loader_t {
+public:
+    enum class format_e {
+        TSV = 0,
+        BIN
+    };
+
+    struct result_t {
+        size_t records;
+        size_t bytes;
+        size_t skipped;     // malformed or empty records
+        size_t failed;      // PUTs which timed out or failed (included in 'records')
+        double seconds;
+    };
+
+    loader_t(std::string const& path, format_e format);
+    ~loader_t();
+
+    // parses file with 'threads' parallel parsers and PUTs all records
+    //  in batches of 'batch_size'. Returns when everything is written.
+    result_t run(executor_t& executor, size_t threads, size_t batch_size);
+
+    // CPUs for parser threads (i-th parser uses placement.cpus_for(i))
+    void set_placement(placement_t const& placement);
+
+    static format_e format_by_name(std::string const& name);
+
+private:
+    struct impl_t;
+    impl_t *m_impl;
+};
+
+#endif //LOADER_HPP
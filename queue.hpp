@@ -21,14 +21,18 @@ public:
 
     // returns true is success, false if element was not enqueued
     bool enqueue(const T & cdata);
+    // enqueues range of elements under single lock
+    template <class It>
+    bool enqueue(It first, It last);
 
     void dequeue(T & cdata);
     bool dequeue(T & cdata, const int timeout_ms);
     void clear();
+    size_t size() const;
     
 private:
     std::deque<T> m_queue;
-    std::mutex m_mutex;
+    mutable std::mutex m_mutex;
     std::condition_variable m_cond_var;
     int m_max_length;
 };
@@ -53,13 +57,11 @@ struct strategy_drop_first {
 template <typename T, typename S>
 bool queue<T, S>::enqueue(const T & cdata)
 {
-    bool was_empty;
     bool result = true;
     
     {
         // The m_mutex must be unlocked when we call notify_one().
         std::lock_guard<std::mutex> lock(m_mutex);
-        was_empty = m_queue.empty();
 
         // check if queue is full
         if (m_max_length != -1 && m_queue.size() >= m_max_length)
@@ -69,12 +71,37 @@ bool queue<T, S>::enqueue(const T & cdata)
             m_queue.push_back(cdata);
     }
     
-    if (was_empty)
-        m_cond_var.notify_one();
+    // there can be several consumers waiting, so wake one up even
+    //  if queue was not empty
+    m_cond_var.notify_one();
 
     return result;
 }
 
+template <typename T, typename S>
+template <class It>
+bool queue<T, S>::enqueue(It first, It last)
+{
+    // bounded queue applies strategy to each element separately
+    if (m_max_length != -1)
+    {
+        bool result = true;
+        for (; first != last; ++first)
+            result = enqueue(*first) && result;
+
+        return result;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.insert(m_queue.end(), first, last);
+    }
+
+    m_cond_var.notify_all();
+
+    return true;
+}
+
 template <typename T, typename S>
 void queue<T, S>::dequeue(T & cdata)
 {
@@ -95,7 +122,7 @@ bool queue<T, S>::dequeue(T & cdata, const int timeout_ms)
     // See 30.5.1
     // We will continue waiting if m_queue is empty. If m_queue is not empty we won't call any "wait" functions.
     if (!m_cond_var.wait_until(lock,
-            std::chrono::system_clock::now() + std::chrono::milliseconds(timeout_ms),
+            std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms),
             [this] { return !m_queue.empty(); }))
     {
         // The timeout "timeout_ms" has expired. m_queue still empty.
@@ -114,5 +141,12 @@ void queue<T, S>::clear()
     m_queue.clear();
 }
 
+template <typename T, typename S>
+size_t queue<T, S>::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size();
+}
+
 #endif // __QUEUE_H__
 
@@ -0,0 +1,258 @@
+#include "rate_workload.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+
+#include "cmd_executor.hpp"
+#include "exception.hpp"
+
+typedef std::chrono::steady_clock clock_type;
+
+// generator does not try to catch up with schedule by more than this
+static const double MAX_LAG_S = 1.0;
+
+struct rate_workload_t::impl_t {
+    executor_t&              executor;
+    size_t                   keys;
+    size_t                   first_key;
+    double                   duration_s;
+    std::string              value;
+
+    std::atomic<double>      rate;
+    std::atomic<size_t>      inflight_limit;
+    std::atomic<unsigned>    mix[3];
+    std::atomic<uint64_t>    rate_changed;  // schedule is restarted when it changes
+
+    std::atomic<bool>        running;
+    std::atomic<uint64_t>    issued;
+    std::atomic<size_t>      inflight;
+    std::atomic<uint64_t>    throttled;
+    std::atomic<double>      lag_s;
+
+    std::mutex               mutex;
+    std::condition_variable  cond;
+
+    impl_t(executor_t& a_executor): executor(a_executor) {}
+
+    op_e next_op(std::mt19937_64& rnd) const;
+    void on_done();
+};
+
+rate_workload_t::rate_workload_t(executor_t& executor, rate_opts_t const& opts)
+    : m_impl(new impl_t(executor))
+{
+    if (opts.keys == 0)
+        throw Exception("rate_workload_t needs at least one key");
+
+    m_impl->keys       = opts.keys;
+    m_impl->first_key  = opts.first_key;
+    m_impl->duration_s = opts.duration_s;
+    m_impl->value.assign(opts.value_size ? opts.value_size : 1, 'x');
+
+    m_impl->rate.store(0);
+    m_impl->rate_changed.store(0);
+    m_impl->running.store(false);
+    m_impl->issued.store(0);
+    m_impl->inflight.store(0);
+    m_impl->throttled.store(0);
+    m_impl->lag_s.store(0);
+
+    set_rate(opts.rate);
+    set_inflight(opts.inflight);
+    set_mix(opts.mix[0], opts.mix[1], opts.mix[2]);
+}
+
+rate_workload_t::~rate_workload_t()
+{
+    delete m_impl;
+}
+
+rate_opts_t rate_workload_t::opts() const
+{
+    rate_opts_t r;
+    r.rate       = m_impl->rate.load();
+    r.inflight   = m_impl->inflight_limit.load();
+    for(int i = 0; i < 3; i++)
+        r.mix[i] = m_impl->mix[i].load();
+    r.keys       = m_impl->keys;
+    r.first_key  = m_impl->first_key;
+    r.value_size = m_impl->value.size();
+    r.duration_s = m_impl->duration_s;
+    return r;
+}
+
+void rate_workload_t::set_rate(double rate)
+{
+    if (rate < 0)
+        throw Exception("Rate cannot be negative");
+
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        m_impl->rate.store(rate);
+        m_impl->rate_changed.fetch_add(1);
+    }
+    m_impl->cond.notify_all();
+}
+
+void rate_workload_t::set_inflight(size_t inflight)
+{
+    if (inflight == 0)
+        throw Exception("Inflight limit must be positive");
+
+    m_impl->inflight_limit.store(inflight);
+    m_impl->cond.notify_all();
+}
+
+void rate_workload_t::set_mix(unsigned put, unsigned get, unsigned del)
+{
+    if (put + get + del == 0)
+        throw Exception("Operation mix cannot be empty");
+
+    m_impl->mix[0].store(put);
+    m_impl->mix[1].store(get);
+    m_impl->mix[2].store(del);
+}
+
+rate_workload_t::state_t rate_workload_t::state() const
+{
+    state_t r;
+    r.issued    = m_impl->issued.load();
+    r.inflight  = m_impl->inflight.load();
+    r.throttled = m_impl->throttled.load();
+    r.lag_s     = m_impl->lag_s.load();
+    return r;
+}
+
+void rate_workload_t::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        m_impl->running.store(false);
+    }
+    m_impl->cond.notify_all();
+}
+
+void rate_workload_t::run()
+{
+    impl_t *impl = m_impl;
+    impl->running.store(true);
+
+    std::mt19937_64 rnd(std::random_device{}());
+    std::uniform_int_distribution<size_t> key_dist(impl->first_key, impl->first_key + impl->keys - 1);
+
+    done_cb_t cb = [impl] (status_e, std::string const&) { impl->on_done(); };
+
+    clock_type::time_point start = clock_type::now();
+    clock_type::time_point next  = start;
+    uint64_t rate_changed = impl->rate_changed.load();
+
+    std::string key;
+    while (impl->running.load())
+    {
+        clock_type::time_point now = clock_type::now();
+        if (impl->duration_s > 0 && now - start >= std::chrono::duration<double>(impl->duration_s))
+            break;
+
+        // new rate starts from now
+        if (impl->rate_changed.load() != rate_changed)
+        {
+            rate_changed = impl->rate_changed.load();
+            next = now;
+        }
+
+        // open loop: operation is issued at its time whatever latency is
+        double rate = impl->rate.load();
+        if (rate > 0)
+        {
+            // change of rate or stop() wakes generator up
+            if (next > now)
+            {
+                std::unique_lock<std::mutex> lock(impl->mutex);
+                if (impl->cond.wait_until(lock, next, [impl, rate_changed] {
+                        return !impl->running.load() || impl->rate_changed.load() != rate_changed; }))
+                    continue;
+            }
+
+            double lag = std::chrono::duration<double>(now - next).count();
+            impl->lag_s.store(lag > 0 ? lag : 0);
+            if (lag > MAX_LAG_S)
+                next = now;
+            next += std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1.0 / rate));
+        }
+
+        // backpressure: limit number of operations in flight
+        if (impl->inflight.load() >= impl->inflight_limit.load())
+        {
+            impl->throttled.fetch_add(1, std::memory_order_relaxed);
+
+            std::unique_lock<std::mutex> lock(impl->mutex);
+            while (impl->running.load() && impl->inflight.load() >= impl->inflight_limit.load())
+                impl->cond.wait_for(lock, std::chrono::milliseconds(10));
+        }
+
+        key = "key" + std::to_string(key_dist(rnd));
+
+        impl->inflight.fetch_add(1);
+        impl->issued.fetch_add(1, std::memory_order_relaxed);
+
+        bool accepted = false;
+        switch(impl->next_op(rnd))
+        {
+        case op_e::PUT:
+            accepted = impl->executor.put_key(key, impl->value, cb);
+            break;
+        case op_e::GET:
+            accepted = impl->executor.get_key(key, cb);
+            break;
+        case op_e::DELETE:
+            accepted = impl->executor.del_key(key, cb);
+            break;
+        }
+
+        // executor is stopped
+        if (!accepted)
+        {
+            impl->on_done();
+            break;
+        }
+    }
+    impl->running.store(false);
+
+    // callbacks must not outlive workload
+    std::unique_lock<std::mutex> lock(impl->mutex);
+    while (impl->inflight.load() > 0)
+        impl->cond.wait_for(lock, std::chrono::milliseconds(10));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation goes here
+op_e rate_workload_t::impl_t::next_op(std::mt19937_64& rnd) const
+{
+    unsigned put = mix[0].load(std::memory_order_relaxed),
+             get = mix[1].load(std::memory_order_relaxed),
+             del = mix[2].load(std::memory_order_relaxed);
+
+    // mix is being changed right now
+    if (put + get + del == 0)
+        return op_e::GET;
+
+    uint64_t r = rnd() % (put + get + del);
+    if (r < put)
+        return op_e::PUT;
+    if (r < put + get)
+        return op_e::GET;
+    return op_e::DELETE;
+}
+
+void rate_workload_t::impl_t::on_done()
+{
+    // generator waits only when limit is reached
+    if (inflight.fetch_sub(1) >= inflight_limit.load())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cond.notify_all();
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef RATE_WORKLOAD_HPP
+#define RATE_WORKLOAD_HPP
+
+#include <string>
+#include <cstdint>
+
+class executor_t;
+
+struct rate_opts_t {
+    double   rate;          // target op/s (0 - as fast as inflight limit allows)
+    size_t   inflight;      // max operations in flight (backpressure)
+    unsigned mix[3];        // shares of PUT, GET and DELETE (indexed by op_e)
+    size_t   keys;          // operations go to random keys of this key space
+    size_t   first_key;     //  starting from this one
+    size_t   value_size;
+    double   duration_s;    // 0 - until stop()
+
+    rate_opts_t(): rate(0), inflight(1000), mix{ 20, 70, 10 }, keys(10000), first_key(0), value_size(100),
+                   duration_s(0) {}
+};
+
+// RUN operation: open-loop generator of PUT/GET/DELETE mix at target rate.
+//  Operations are asynchronous, latencies are collected by executor.
+//  Rate, inflight limit and mix may be changed while it runs
+//  (see control_t), so one run can sweep several load levels.
+class rate_workload_t {
+public:
+    rate_workload_t(executor_t& executor, rate_opts_t const& opts);
+    ~rate_workload_t();
+
+    // issues operations until duration passes or stop() is called,
+    //  returns when all of them are completed
+    void run();
+    void stop();
+
+    // may be called from any thread
+    rate_opts_t opts() const;
+    void set_rate(double rate);
+    void set_inflight(size_t inflight);
+    void set_mix(unsigned put, unsigned get, unsigned del);
+
+    struct state_t {
+        uint64_t issued;
+        size_t   inflight;
+        uint64_t throttled;     // operations delayed by inflight limit
+        double   lag_s;         // how much generator is behind schedule
+    };
+    state_t state() const;
+
+private:
+    struct impl_t;
+    impl_t *m_impl;
+};
+
+#endif //RATE_WORKLOAD_HPP
@@ -0,0 +1,200 @@
+#include "replay.hpp"
+
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "cmd_executor.hpp"
+#include "histogram.hpp"
+#include "trace.hpp"
+
+typedef std::chrono::steady_clock clock_type;
+
+static const char* op_names[] = { "PUT", "GET", "DELETE" };
+
+struct replayer_t::impl_t {
+    std::string              path;
+
+    // latencies per operation type, and all operations for current interval
+    histogram_t              latency[3];
+    histogram_t              interval;
+
+    std::atomic<uint64_t>    done;
+    std::atomic<uint64_t>    timeouts;
+    std::atomic<uint64_t>    errors;
+    std::atomic<size_t>      inflight;
+
+    std::mutex               mutex;
+    std::condition_variable  cond;
+
+    void on_done(op_e op, status_e status, clock_type::time_point issued, size_t limit);
+    void report(clock_type::time_point start, std::atomic_bool const& running);
+};
+
+replayer_t::replayer_t(std::string const& path)
+    : m_impl(new impl_t)
+{
+    m_impl->path = path;
+}
+
+replayer_t::~replayer_t()
+{
+    delete m_impl;
+}
+
+replayer_t::result_t replayer_t::run(executor_t& executor, double speed, size_t inflight)
+{
+    if (inflight == 0)
+        inflight = 1;
+
+    trace_reader_t reader(m_impl->path);
+
+    for(histogram_t& h : m_impl->latency)
+        h.reset();
+    m_impl->interval.reset();
+    m_impl->done.store(0);
+    m_impl->timeouts.store(0);
+    m_impl->errors.store(0);
+    m_impl->inflight.store(0);
+
+    if (speed > 0)
+        printf("Replaying %s at %.2fx speed\n", m_impl->path.c_str(), speed);
+    else
+        printf("Replaying %s at maximum speed\n", m_impl->path.c_str());
+
+    clock_type::time_point start = clock_type::now();
+
+    std::atomic_bool running(true);
+    std::thread reporter(&impl_t::report, m_impl, start, std::cref(running));
+
+    // one value buffer is enough: PUT copies value into its command
+    std::string value;
+    trace_record_t rec;
+
+    while (reader.next(&rec))
+    {
+        if (speed > 0)
+            std::this_thread::sleep_until(start + std::chrono::microseconds(uint64_t(rec.timestamp_us / speed)));
+
+        // limit number of operations in flight
+        if (m_impl->inflight.load() >= inflight)
+        {
+            std::unique_lock<std::mutex> lock(m_impl->mutex);
+            while (m_impl->inflight.load() >= inflight)
+                m_impl->cond.wait_for(lock, std::chrono::milliseconds(10));
+        }
+
+        m_impl->inflight.fetch_add(1);
+
+        impl_t *impl = m_impl;
+        op_e op = rec.op;
+        clock_type::time_point now = clock_type::now();
+        done_cb_t cb = [impl, op, now, inflight] (status_e status, std::string const&)
+            {
+                impl->on_done(op, status, now, inflight);
+            };
+
+        switch(rec.op)
+        {
+        case op_e::PUT:
+            value.assign(rec.value_size ? rec.value_size : 1, 'x');
+            executor.put_key(rec.key, value, cb);
+            break;
+        case op_e::GET:
+            executor.get_key(rec.key, cb);
+            break;
+        case op_e::DELETE:
+            executor.del_key(rec.key, cb);
+            break;
+        }
+    }
+
+    executor.sync();
+
+    result_t r;
+    r.seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+    running.store(false);
+    reporter.join();
+
+    histogram_t all;
+    for(int i = 0; i < 3; i++)
+    {
+        histogram_t& h = m_impl->latency[i];
+        if (h.count() == 0)
+            continue;
+
+        printf("  %-6s: %8llu ops, p50 %6llu us, p99 %6llu us, p99.9 %6llu us, max %6llu us\n",
+               op_names[i], (unsigned long long)h.count(),
+               (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(99),
+               (unsigned long long)h.percentile(99.9), (unsigned long long)h.max());
+        all.merge(h);
+    }
+
+    if (m_impl->timeouts.load())
+        printf("  %llu operations timed out\n", (unsigned long long)m_impl->timeouts.load());
+    if (m_impl->errors.load())
+        printf("  %llu operations failed\n", (unsigned long long)m_impl->errors.load());
+
+    r.ops      = m_impl->done.load();
+    r.timeouts = m_impl->timeouts.load();
+    r.errors   = m_impl->errors.load();
+    r.p50_us  = all.percentile(50);
+    r.p99_us  = all.percentile(99);
+    r.p999_us = all.percentile(99.9);
+
+    return r;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation goes here
+void replayer_t::impl_t::on_done(op_e op, status_e status, clock_type::time_point issued, size_t limit)
+{
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - issued).count();
+
+    if (status == status_e::OK)
+    {
+        latency[int(op)].record(us);
+        interval.record(us);
+        done.fetch_add(1);
+    } else
+    if (status == status_e::TIMEOUT)
+        timeouts.fetch_add(1);
+    else
+        errors.fetch_add(1);
+
+    // wake up dispatcher if it waits for free slot
+    if (inflight.fetch_sub(1) == limit)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cond.notify_one();
+    }
+}
+
+void replayer_t::impl_t::report(clock_type::time_point start, std::atomic_bool const& running)
+{
+    histogram_t h;
+    uint64_t last_done = 0;
+
+    while (running.load())
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        h.reset();
+        interval.drain_to(h);
+
+        uint64_t cur_done = done.load();
+        double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+
+        printf("  %6.1fs: %8llu ops/s, in flight %5zu, p50 %6llu us, p99 %6llu us, p99.9 %6llu us\n",
+               elapsed, (unsigned long long)(cur_done - last_done), inflight.load(),
+               (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(99),
+               (unsigned long long)h.percentile(99.9));
+        fflush(stdout);
+
+        last_done = cur_done;
+    }
+}
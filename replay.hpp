@@ -0,0 +1,35 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <string>
+#include <cstdint>
+
+class executor_t;
+
+// Replays operations from trace file (see trace.hpp) through executor.
+//  Trace is streamed from disk, operations are issued asynchronously.
+class replayer_t {
+public:
+    struct result_t {
+        uint64_t ops;
+        uint64_t timeouts;      // dropped by executor because of deadline
+        uint64_t errors;        // failed and not retried (or rejected by breakers)
+        double   seconds;
+        uint64_t p50_us;
+        uint64_t p99_us;
+        uint64_t p999_us;
+    };
+
+    replayer_t(std::string const& path);
+    ~replayer_t();
+
+    // speed: 1.0 - original timing, 2.0 - twice faster, 0 - as fast as possible
+    //  'inflight' limits number of operations executed at the same time
+    result_t run(executor_t& executor, double speed, size_t inflight);
+
+private:
+    struct impl_t;
+    impl_t *m_impl;
+};
+
+#endif //REPLAY_HPP
@@ -0,0 +1,643 @@
+#include "reporter.hpp"
+
+#include <unistd.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <ctime>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "exception.hpp"
+
+#ifndef GIT_REVISION
+#define GIT_REVISION "unknown"
+#endif
+
+typedef std::chrono::steady_clock clock_type;
+
+static const char* op_names[] = { "PUT", "GET", "DELETE" };
+static const char* lane_names[] = { "interactive", "normal", "bulk" };
+static const int    GET_INDEX   = 1;
+
+std::string git_revision()
+{
+    return GIT_REVISION;
+}
+
+static std::string json_escape(std::string const& s)
+{
+    std::string r;
+    for(char c : s)
+    {
+        switch(c)
+        {
+        case '"':  r += "\\\""; break;
+        case '\\': r += "\\\\"; break;
+        case '\n': r += "\\n";  break;
+        case '\t': r += "\\t";  break;
+        default:
+            if ((unsigned char)c < 0x20)
+            {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                r += buf;
+            } else
+                r += c;
+        }
+    }
+    return r;
+}
+
+static void append(std::string& out, const char *fmt, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    out += buf;
+}
+
+struct reporter_t::impl_t {
+    enum class format_e {
+        NONE = 0,
+        CSV,
+        JSON
+    };
+
+    stats_source_t      source;
+    executor_stats_t    stats;          // the latest data from source
+    double              interval_s;
+    std::string         path;
+    format_e            format;
+    FILE               *file;
+
+    std::vector< std::pair<std::string, std::string> > meta;
+
+    // accumulated over the whole run
+    histogram_t         total[3];
+    histogram_t         total_queue_delay[3];   // per priority lane
+    uint64_t            last_ops[3];
+    uint64_t            last_errors[3];
+    uint64_t            total_errors[3];
+    uint64_t            last_timeouts[3];
+    uint64_t            total_timeouts[3];
+    double              active_s[3];        // time of intervals where operation was seen
+
+    // hedged GETs: values at start and at the last tick
+    uint64_t            start_hedges, start_hedge_wins;
+    uint64_t            last_hedges, last_hedge_wins;
+
+    // retries of failed operations and operations given up
+    uint64_t            start_retries, start_failed;
+    uint64_t            last_retries, last_failed;
+
+    clock_type::time_point start_time;
+    clock_type::time_point last_tick;
+    bool                first_row;
+
+    std::thread             thread;
+    std::mutex              mutex;
+    std::condition_variable cond;
+    bool                    running;
+
+    // text of the latest interval (see last_report)
+    mutable std::mutex      last_mutex;
+    std::string             last;
+
+    // file is written by tick() and note()
+    std::mutex              file_mutex;
+
+    void worker();
+    void tick();
+    void write_header();
+    void write_summary();
+};
+
+reporter_t::reporter_t(stats_source_t const& source, double interval_s, std::string const& path)
+    : m_impl(new impl_t)
+{
+    m_impl->source  = source;
+    m_impl->interval_s = interval_s > 0 ? interval_s : 1.0;
+    m_impl->path    = path;
+    m_impl->file    = 0;
+    m_impl->running = false;
+    m_impl->format  = impl_t::format_e::NONE;
+
+    if (path.empty())
+        return;
+
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".csv") == 0)
+        m_impl->format = impl_t::format_e::CSV;
+    else
+    if (path.size() > 5 && path.compare(path.size() - 5, 5, ".json") == 0)
+        m_impl->format = impl_t::format_e::JSON;
+    else
+    {
+        delete m_impl;
+        throw Exception("Results file must have .csv or .json extension: <" + path + ">");
+    }
+
+    m_impl->file = fopen(path.c_str(), "w");
+    if (!m_impl->file)
+    {
+        delete m_impl;
+        throw Exception("Failed to create results file <" + path + ">: " + strerror(errno));
+    }
+}
+
+reporter_t::~reporter_t()
+{
+    stop();
+
+    if (m_impl->file)
+        fclose(m_impl->file);
+
+    delete m_impl;
+}
+
+void reporter_t::set_meta(std::string const& name, std::string const& value)
+{
+    m_impl->meta.push_back(std::make_pair(name, value));
+}
+
+void reporter_t::start()
+{
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+
+    char started[64] = "";
+    time_t now = time(0);
+    strftime(started, sizeof(started), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    set_meta("revision", git_revision());
+    set_meta("host", host);
+    set_meta("started", started);
+
+    // drop whatever executor collected before
+    m_impl->source(m_impl->stats);
+    for(int i = 0; i < 3; i++)
+    {
+        m_impl->stats.op[i].latency.reset();
+
+        m_impl->total[i].reset();
+        m_impl->stats.queue_delay[i].reset();
+        m_impl->total_queue_delay[i].reset();
+        m_impl->last_ops[i]     = m_impl->stats.op[i].ops.load();
+        m_impl->last_errors[i]  = m_impl->stats.op[i].errors.load();
+        m_impl->total_errors[i] = 0;
+        m_impl->last_timeouts[i]  = m_impl->stats.op[i].timeouts.load();
+        m_impl->total_timeouts[i] = 0;
+        m_impl->active_s[i]     = 0;
+    }
+    m_impl->start_hedges     = m_impl->last_hedges     = m_impl->stats.hedges.load();
+    m_impl->start_hedge_wins = m_impl->last_hedge_wins = m_impl->stats.hedge_wins.load();
+    m_impl->start_retries    = m_impl->last_retries    = m_impl->stats.retries.load();
+    m_impl->start_failed     = m_impl->last_failed     = m_impl->stats.failed.load();
+
+    m_impl->write_header();
+
+    m_impl->start_time = m_impl->last_tick = clock_type::now();
+    m_impl->first_row  = true;
+    m_impl->running    = true;
+    m_impl->thread = std::thread(&impl_t::worker, m_impl);
+}
+
+std::string reporter_t::last_report() const
+{
+    std::lock_guard<std::mutex> lock(m_impl->last_mutex);
+    return m_impl->last;
+}
+
+void reporter_t::note(std::string const& text)
+{
+    double elapsed = std::chrono::duration<double>(clock_type::now() - m_impl->start_time).count();
+
+    printf("  [%7.1fs] note   %s\n", elapsed, text.c_str());
+    fflush(stdout);
+
+    std::lock_guard<std::mutex> lock(m_impl->file_mutex);
+    if (m_impl->format == impl_t::format_e::CSV)
+        fprintf(m_impl->file, "# %.3f: %s\n", elapsed, text.c_str());
+    else
+    if (m_impl->format == impl_t::format_e::JSON)
+    {
+        fprintf(m_impl->file, "%s\n    {\"elapsed_s\": %.3f, \"note\": \"%s\"}",
+                m_impl->first_row ? "" : ",", elapsed, json_escape(text).c_str());
+        m_impl->first_row = false;
+    }
+    if (m_impl->file)
+        fflush(m_impl->file);
+}
+
+void reporter_t::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        if (!m_impl->running)
+            return;
+
+        m_impl->running = false;
+    }
+    m_impl->cond.notify_one();
+    m_impl->thread.join();
+
+    // the last (partial) interval
+    m_impl->tick();
+    m_impl->write_summary();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation goes here
+void reporter_t::impl_t::worker()
+{
+    clock_type::time_point next = start_time;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running)
+    {
+        next += std::chrono::microseconds(uint64_t(interval_s * 1e6));
+        if (cond.wait_until(lock, next, [this] { return !running; }))
+            break;
+
+        tick();
+    }
+}
+
+void reporter_t::impl_t::write_header()
+{
+    if (format == format_e::CSV)
+    {
+        for(auto const& m : meta)
+            fprintf(file, "# %s: %s\n", m.first.c_str(), m.second.c_str());
+        fprintf(file, "elapsed_s,op,ops,ops_per_s,errors,timeouts,p50_us,p90_us,p99_us,p999_us,max_us\n");
+    } else
+    if (format == format_e::JSON)
+    {
+        fprintf(file, "{\n  \"meta\": {");
+        for(size_t i = 0; i < meta.size(); i++)
+            fprintf(file, "%s\n    \"%s\": \"%s\"", i ? "," : "",
+                    json_escape(meta[i].first).c_str(), json_escape(meta[i].second).c_str());
+        fprintf(file, "\n  },\n  \"intervals\": [");
+    }
+    if (file)
+        fflush(file);
+}
+
+void reporter_t::impl_t::tick()
+{
+    clock_type::time_point now = clock_type::now();
+    double elapsed = std::chrono::duration<double>(now - start_time).count();
+    double dt      = std::chrono::duration<double>(now - last_tick).count();
+    last_tick = now;
+
+    if (dt <= 0)
+        return;
+
+    source(stats);
+
+    std::lock_guard<std::mutex> lock(file_mutex);
+    std::string out;
+
+    uint64_t gets = 0;     // GETs completed in interval
+    for(int i = 0; i < 3; i++)
+    {
+        op_stats_t& st = stats.op[i];
+
+        histogram_t h;
+        st.latency.drain_to(h);
+        total[i].merge(h);
+
+        uint64_t ops    = st.ops.load(std::memory_order_relaxed);
+        uint64_t errors = st.errors.load(std::memory_order_relaxed);
+        uint64_t d_ops  = ops - last_ops[i];
+        uint64_t d_err  = errors - last_errors[i];
+        last_ops[i]    = ops;
+        last_errors[i] = errors;
+        total_errors[i] += d_err;
+
+        uint64_t timeouts = st.timeouts.load(std::memory_order_relaxed);
+        uint64_t d_tmo    = timeouts - last_timeouts[i];
+        last_timeouts[i]  = timeouts;
+        total_timeouts[i] += d_tmo;
+        if (i == GET_INDEX)
+            gets = d_ops;
+
+        if (d_ops == 0 && d_err == 0 && d_tmo == 0)
+            continue;
+        active_s[i] += dt;
+
+        unsigned long long
+            p50  = h.percentile(50),
+            p90  = h.percentile(90),
+            p99  = h.percentile(99),
+            p999 = h.percentile(99.9),
+            max  = h.max();
+
+        append(out, "  [%7.1fs] %-6s %9.0f op/s  err %-5llu tmo %-5llu p50 %6llu  p99 %6llu  p99.9 %6llu  max %6llu us\n",
+               elapsed, op_names[i], d_ops / dt, (unsigned long long)d_err, (unsigned long long)d_tmo,
+               p50, p99, p999, max);
+
+        if (format == format_e::CSV)
+            fprintf(file, "%.3f,%s,%llu,%.1f,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                    elapsed, op_names[i], (unsigned long long)d_ops, d_ops / dt,
+                    (unsigned long long)d_err, (unsigned long long)d_tmo, p50, p90, p99, p999, max);
+        else
+        if (format == format_e::JSON)
+            fprintf(file, "%s\n    {\"elapsed_s\": %.3f, \"op\": \"%s\", \"ops\": %llu, \"ops_per_s\": %.1f, "
+                    "\"errors\": %llu, \"timeouts\": %llu, \"p50_us\": %llu, \"p90_us\": %llu, \"p99_us\": %llu, "
+                    "\"p999_us\": %llu, \"max_us\": %llu}",
+                    first_row ? "" : ",", elapsed, op_names[i], (unsigned long long)d_ops, d_ops / dt,
+                    (unsigned long long)d_err, (unsigned long long)d_tmo, p50, p90, p99, p999, max);
+        first_row = false;
+    }
+
+    // time spent in executor queue
+    for(int i = 0; i < 3; i++)
+    {
+        histogram_t h;
+        stats.queue_delay[i].drain_to(h);
+        if (h.count() == 0)
+            continue;
+        total_queue_delay[i].merge(h);
+
+        append(out, "  [%7.1fs] queue  %-11s %9llu cmds  wait p50 %6llu  p99 %6llu  max %6llu us\n",
+               elapsed, lane_names[i], (unsigned long long)h.count(),
+               (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(99),
+               (unsigned long long)h.max());
+    }
+
+    uint64_t hedges = stats.hedges.load(), wins = stats.hedge_wins.load();
+    if (hedges != last_hedges)
+    {
+        uint64_t d_hedges = hedges - last_hedges, d_wins = wins - last_hedge_wins;
+        append(out, "  [%7.1fs] hedge  %9llu sent  %5.1f%% of GETs  won %llu (%.1f%%)\n",
+               elapsed, (unsigned long long)d_hedges, gets ? 100.0 * d_hedges / gets : 0.0,
+               (unsigned long long)d_wins, 100.0 * d_wins / d_hedges);
+    }
+    last_hedges = hedges;
+    last_hedge_wins = wins;
+
+    uint64_t retries = stats.retries.load(), failed = stats.failed.load();
+    if (retries != last_retries || failed != last_failed)
+        append(out, "  [%7.1fs] retry  %9llu sent  %llu failed\n",
+               elapsed, (unsigned long long)(retries - last_retries), (unsigned long long)(failed - last_failed));
+    last_retries = retries;
+    last_failed = failed;
+
+    fputs(out.c_str(), stdout);
+    fflush(stdout);
+
+    {
+        std::lock_guard<std::mutex> lock(last_mutex);
+        last.swap(out);
+    }
+
+    if (file)
+        fflush(file);
+}
+
+void reporter_t::impl_t::write_summary()
+{
+    double duration = std::chrono::duration<double>(last_tick - start_time).count();
+
+    if (format == format_e::JSON)
+        fprintf(file, "\n  ],\n  \"duration_s\": %.3f,\n  \"summary\": {", duration);
+
+    bool first = true;
+    for(int i = 0; i < 3; i++)
+    {
+        histogram_t& h = total[i];
+        if (h.count() == 0 && total_errors[i] == 0 && total_timeouts[i] == 0)
+            continue;
+
+        double rate = active_s[i] > 0 ? h.count() / active_s[i] : 0;
+
+        printf("  %-6s total: %llu ops, %.0f op/s, %llu errors, %llu timeouts, mean %.0f us, p50 %llu, p99 %llu, p99.9 %llu us\n",
+               op_names[i], (unsigned long long)h.count(), rate, (unsigned long long)total_errors[i],
+               (unsigned long long)total_timeouts[i], h.mean(), (unsigned long long)h.percentile(50),
+               (unsigned long long)h.percentile(99), (unsigned long long)h.percentile(99.9));
+
+        if (format == format_e::JSON)
+            fprintf(file, "%s\n    \"%s\": {\"ops\": %llu, \"ops_per_s\": %.1f, \"errors\": %llu, "
+                    "\"timeouts\": %llu, \"mean_us\": %.1f, \"p50_us\": %llu, \"p90_us\": %llu, \"p99_us\": %llu, "
+                    "\"p999_us\": %llu, \"max_us\": %llu}",
+                    first ? "" : ",", op_names[i], (unsigned long long)h.count(), rate,
+                    (unsigned long long)total_errors[i], (unsigned long long)total_timeouts[i], h.mean(),
+                    (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(90),
+                    (unsigned long long)h.percentile(99), (unsigned long long)h.percentile(99.9),
+                    (unsigned long long)h.max());
+        first = false;
+    }
+
+    for(int i = 0; i < 3; i++)
+    {
+        histogram_t& h = total_queue_delay[i];
+        if (h.count() == 0)
+            continue;
+
+        printf("  queue  %-11s total: %llu cmds, wait mean %.0f us, p50 %llu, p99 %llu, p99.9 %llu us\n",
+               lane_names[i], (unsigned long long)h.count(), h.mean(),
+               (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(99),
+               (unsigned long long)h.percentile(99.9));
+
+        if (format == format_e::JSON)
+            fprintf(file, "%s\n    \"queue_%s\": {\"cmds\": %llu, \"mean_us\": %.1f, \"p50_us\": %llu, "
+                    "\"p99_us\": %llu, \"p999_us\": %llu, \"max_us\": %llu}",
+                    first ? "" : ",", lane_names[i], (unsigned long long)h.count(), h.mean(),
+                    (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(99),
+                    (unsigned long long)h.percentile(99.9), (unsigned long long)h.max());
+        first = false;
+    }
+
+    uint64_t hedges = last_hedges - start_hedges, wins = last_hedge_wins - start_hedge_wins;
+    if (hedges > 0)
+    {
+        uint64_t gets = total[GET_INDEX].count();
+        printf("  hedge  total: %llu sent, %.1f%% of GETs, won %llu (%.1f%%)\n",
+               (unsigned long long)hedges, gets ? 100.0 * hedges / gets : 0.0,
+               (unsigned long long)wins, 100.0 * wins / hedges);
+
+        if (format == format_e::JSON)
+            fprintf(file, "%s\n    \"hedge\": {\"sent\": %llu, \"rate_pct\": %.2f, \"wins\": %llu, \"win_rate_pct\": %.2f}",
+                    first ? "" : ",", (unsigned long long)hedges, gets ? 100.0 * hedges / gets : 0.0,
+                    (unsigned long long)wins, 100.0 * wins / hedges);
+        first = false;
+    }
+
+    uint64_t retries = last_retries - start_retries, failed = last_failed - start_failed;
+    if (retries > 0 || failed > 0)
+    {
+        printf("  retry  total: %llu sent, %llu failed\n",
+               (unsigned long long)retries, (unsigned long long)failed);
+
+        if (format == format_e::JSON)
+            fprintf(file, "%s\n    \"retry\": {\"sent\": %llu, \"failed\": %llu}",
+                    first ? "" : ",", (unsigned long long)retries, (unsigned long long)failed);
+        first = false;
+    }
+
+    if (format == format_e::JSON)
+        fprintf(file, "\n  }\n}\n");
+    if (file)
+        fflush(file);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Comparison of results
+//
+// Minimal JSON reader: flattens document into "a.b.0.c" -> value map
+//  (enough for files written by reporter_t)
+typedef std::map<std::string, std::string> flat_json_t;
+
+static void json_skip_ws(const char*& p, const char *end)
+{
+    while (p < end && isspace((unsigned char)*p))
+        p++;
+}
+
+static std::string json_string(const char*& p, const char *end)
+{
+    std::string r;
+    for(p++; p < end && *p != '"'; p++)
+    {
+        if (*p == '\\' && p + 1 < end)
+        {
+            p++;
+            switch(*p)
+            {
+            case 'n': r += '\n'; break;
+            case 't': r += '\t'; break;
+            case 'u': p += 4; r += '?'; break;
+            default:  r += *p;
+            }
+        } else
+            r += *p;
+    }
+    if (p >= end)
+        throw Exception("Unterminated string in JSON");
+    p++;
+    return r;
+}
+
+static void json_value(const char*& p, const char *end, std::string const& path, flat_json_t *out)
+{
+    json_skip_ws(p, end);
+    if (p >= end)
+        throw Exception("Unexpected end of JSON");
+
+    std::string prefix = path.empty() ? "" : path + ".";
+
+    if (*p == '{' || *p == '[')
+    {
+        bool object = (*p == '{');
+        char close = object ? '}' : ']';
+        size_t index = 0;
+
+        p++;
+        json_skip_ws(p, end);
+        while (p < end && *p != close)
+        {
+            std::string name;
+            if (object)
+            {
+                if (*p != '"')
+                    throw Exception("Expected name in JSON object");
+                name = json_string(p, end);
+                json_skip_ws(p, end);
+                if (p >= end || *p != ':')
+                    throw Exception("Expected ':' in JSON object");
+                p++;
+            } else
+                name = std::to_string(index++);
+
+            json_value(p, end, prefix + name, out);
+
+            json_skip_ws(p, end);
+            if (p < end && *p == ',')
+            {
+                p++;
+                json_skip_ws(p, end);
+            }
+        }
+        if (p >= end)
+            throw Exception("Unexpected end of JSON");
+        p++;
+    } else
+    if (*p == '"')
+        (*out)[path] = json_string(p, end);
+    else
+    {
+        const char *b = p;
+        while (p < end && *p != ',' && *p != '}' && *p != ']' && !isspace((unsigned char)*p))
+            p++;
+        (*out)[path] = std::string(b, p);
+    }
+}
+
+static flat_json_t read_results(std::string const& path)
+{
+    std::ifstream f(path.c_str());
+    if (!f)
+        throw Exception("Failed to open results file <" + path + ">");
+
+    std::stringstream ss;
+    ss << f.rdbuf();
+    std::string text = ss.str();
+
+    flat_json_t r;
+    const char *p = text.data();
+    json_value(p, p + text.size(), "", &r);
+    return r;
+}
+
+int compare_results(std::string const& baseline, std::string const& current, double threshold_pct)
+{
+    flat_json_t base = read_results(baseline);
+    flat_json_t cur  = read_results(current);
+
+    printf("Baseline: %s (revision %s)\n", baseline.c_str(), base["meta.revision"].c_str());
+    printf("Current : %s (revision %s)\n", current.c_str(), cur["meta.revision"].c_str());
+    printf("\n%-18s %12s %12s %9s\n", "metric", "baseline", "current", "change");
+
+    // metric name and whether higher value is better
+    static const std::pair<const char*, bool> metrics[] = {
+        { "ops_per_s", true  },
+        { "p50_us",    false },
+        { "p99_us",    false },
+        { "p999_us",   false },
+    };
+
+    int regressions = 0;
+    for(const char *op : op_names)
+        for(auto const& m : metrics)
+        {
+            std::string key = std::string("summary.") + op + "." + m.first;
+            if (!base.count(key) || !cur.count(key))
+                continue;
+
+            double b = atof(base[key].c_str());
+            double c = atof(cur[key].c_str());
+            double change = b != 0 ? (c - b) / b * 100.0 : 0.0;
+
+            bool worse = m.second ? (change < -threshold_pct) : (change > threshold_pct);
+            if (worse)
+                regressions++;
+
+            printf("%-6s %-11s %12.1f %12.1f %+8.1f%%%s\n", op, m.first, b, c, change,
+                   worse ? "  REGRESSION" : "");
+        }
+
+    printf("\n%i regression(s) with threshold %.1f%%\n", regressions, threshold_pct);
+    return regressions;
+}
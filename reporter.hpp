@@ -0,0 +1,46 @@
+#ifndef REPORTER_HPP
+#define REPORTER_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "stats.hpp"
+
+// Periodic reporter of executor statistics.
+//  Each interval it prints throughput, errors and latency percentiles
+//  to stdout and (optionally) appends them to results file.
+//  Results file format is chosen by extension: .csv or .json
+class reporter_t {
+public:
+    reporter_t(stats_source_t const& source, double interval_s, std::string const& path = "");
+    ~reporter_t();
+
+    // run metadata (nodes, workers, workload, ...), must be set before start()
+    void set_meta(std::string const& name, std::string const& value);
+
+    void start();
+    // reports the last interval and run summary, closes results file
+    void stop();
+
+    // lines printed for the latest interval (empty before the first one)
+    std::string last_report() const;
+
+    // event (e.g. changed setting) printed and written to results file
+    //  with time it happened at
+    void note(std::string const& text);
+
+private:
+    struct impl_t;
+    impl_t *m_impl;
+};
+
+// Compares two JSON results files written by reporter_t.
+//  Prints table of differences and returns number of regressions
+//  (throughput lower or latency higher than baseline by more than threshold)
+int compare_results(std::string const& baseline, std::string const& current, double threshold_pct);
+
+// revision of sources tester was built from
+std::string git_revision();
+
+#endif //REPORTER_HPP
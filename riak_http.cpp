@@ -0,0 +1,441 @@
+#include "riak_http.hpp"
+
+#include <cstring>
+#include <cassert>
+#include <cerrno>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+static const char PATH[]         = "/buckets/test/keys/";
+static const char CONTENT_TYPE[] = "text/plain";
+
+// max size of response we agree to read
+static const size_t MAX_HEADER  = 64 * 1024;
+static const size_t MAX_MESSAGE = 64 * 1024 * 1024;
+
+static const size_t IN_BUFFER   = 64 * 1024;
+
+////////////////////////////////////////////////////////////////////////////////
+// Encoding
+static void put_key_path(std::string& out, slice_t const& key)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    out.append(PATH, sizeof(PATH) - 1);
+    for(size_t i = 0; i < key.size; i++)
+    {
+        unsigned char c = key.data[i];
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+            out += char(c);
+        else
+        {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Decoding: header values are parsed in place
+static bool header_is(const char *p, const char *end, const char *name)
+{
+    size_t len = strlen(name);
+    return size_t(end - p) > len && p[len] == ':' && strncasecmp(p, name, len) == 0;
+}
+
+static const char* header_value(const char *p, const char *end)
+{
+    p = (const char*)memchr(p, ':', end - p) + 1;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+riak_http::riak_http(std::string host, int portnum)
+    : m_host(host)
+    , m_port(portnum)
+    , m_fd(-1)
+    , m_connect_timeout_ms(0)
+    , m_timeout_ms(0)
+    , m_in(IN_BUFFER)
+    , m_in_begin(0)
+    , m_in_end(0)
+    , m_closing(false)
+{
+}
+
+riak_http::~riak_http()
+{
+    close();
+}
+
+void riak_http::close()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+    m_in_begin = m_in_end = 0;
+    m_closing = false;
+}
+
+bool riak_http::connect(int timeout_ms)
+{
+    close();
+    m_connect_timeout_ms = timeout_ms;
+
+    addrinfo hints, *res = 0;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(m_host.c_str(), std::to_string(m_port).c_str(), &hints, &res) != 0)
+        return false;
+
+    for(addrinfo *ai = res; ai && m_fd < 0; ai = ai->ai_next)
+    {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        // non-blocking connect is limited by timeout
+        int rc = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (rc != 0 && errno == EINPROGRESS)
+        {
+            pollfd pfd = { fd, POLLOUT, 0 };
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (poll(&pfd, 1, timeout_ms > 0 ? timeout_ms : -1) == 1
+                && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0)
+                rc = 0;
+        }
+
+        if (rc != 0)
+        {
+            ::close(fd);
+            continue;
+        }
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+        // small requests of pipeline must not wait for each other
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        m_fd = fd;
+    }
+    freeaddrinfo(res);
+
+    if (m_fd < 0)
+        return false;
+
+    m_timeout_ms = -1;
+    set_timeout(timeout_ms);
+    return true;
+}
+
+bool riak_http::reconnect()
+{
+    return connect(m_connect_timeout_ms);
+}
+
+void riak_http::set_timeout(int timeout_ms)
+{
+    if (timeout_ms == m_timeout_ms || m_fd < 0)
+        return;
+
+    struct timeval tv;
+    tv.tv_sec  = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    if (setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0
+        && setsockopt(m_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == 0)
+        m_timeout_ms = timeout_ms;
+}
+
+bool riak_http::is_error_code(int code)
+{
+    // connection state is unknown after these errors
+    return code == ERROR_COMMUNICATION || code == ERROR_PROTOCOL;
+}
+
+void riak_http::add_request(op_t const& op)
+{
+    switch(op.type)
+    {
+    case op_t::PUT:
+        m_out.append("PUT ");
+        break;
+    case op_t::GET:
+        m_out.append("GET ");
+        break;
+    case op_t::DELETE:
+        m_out.append("DELETE ");
+        break;
+    }
+
+    put_key_path(m_out, op.key);
+    m_out.append(" HTTP/1.1\r\nHost: ");
+    m_out.append(m_host);
+    m_out.append("\r\n");
+
+    if (op.type == op_t::PUT)
+    {
+        m_out.append("Content-Type: ");
+        m_out.append(CONTENT_TYPE, sizeof(CONTENT_TYPE) - 1);
+        m_out.append("\r\nContent-Length: ");
+        m_out.append(std::to_string(op.value.size));
+        m_out.append("\r\n\r\n");
+        m_out.append(op.value.data, op.value.size);
+    } else
+        m_out.append("\r\n");
+}
+
+bool riak_http::send_all()
+{
+    for(size_t sent = 0; sent < m_out.size(); )
+    {
+        ssize_t n = send(m_fd, m_out.data() + sent, m_out.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+bool riak_http::fill()
+{
+    if (m_in_begin == m_in_end)
+        m_in_begin = m_in_end = 0;
+
+    // free space: move unparsed data to the beginning or grow buffer
+    if (m_in_end == m_in.size())
+    {
+        if (m_in_begin > 0)
+        {
+            memmove(m_in.data(), m_in.data() + m_in_begin, m_in_end - m_in_begin);
+            m_in_end -= m_in_begin;
+            m_in_begin = 0;
+        } else
+            m_in.resize(m_in.size() * 2);
+    }
+
+    for(;;)
+    {
+        ssize_t n = recv(m_fd, m_in.data() + m_in_end, m_in.size() - m_in_end, 0);
+        if (n > 0)
+        {
+            m_in_end += n;
+            return true;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        return false;
+    }
+}
+
+int riak_http::read_response(int *status, slice_t *body)
+{
+    // header is complete when empty line is received
+    size_t hdr_size;
+    size_t scanned = 0;
+    for(;;)
+    {
+        const char *begin = m_in.data() + m_in_begin;
+        size_t avail = m_in_end - m_in_begin;
+
+        const char *p = (const char*)memmem(begin + scanned, avail - scanned, "\r\n\r\n", 4);
+        if (p)
+        {
+            hdr_size = p + 4 - begin;
+            break;
+        }
+
+        if (avail > MAX_HEADER)
+            return ERROR_PROTOCOL;
+
+        // terminator may be split between reads
+        scanned = avail >= 3 ? avail - 3 : 0;
+        if (!fill())
+            return ERROR_COMMUNICATION;
+    }
+
+    const char *p   = m_in.data() + m_in_begin;
+    const char *end = p + hdr_size;
+
+    // status line: HTTP/1.1 200 OK
+    if (end - p < 12 || strncmp(p, "HTTP/1.", 7) != 0 || p[8] != ' ')
+        return ERROR_PROTOCOL;
+    *status = atoi(p + 9);
+    bool http10 = p[7] == '0';
+
+    size_t length = 0;
+    bool has_length = false;
+    bool close = http10;
+
+    for(p = (const char*)memchr(p, '\n', end - p) + 1; p < end - 2; )
+    {
+        const char *eol = (const char*)memchr(p, '\n', end - p);
+
+        if (header_is(p, eol, "Content-Length"))
+        {
+            length = strtoull(header_value(p, eol), 0, 10);
+            has_length = true;
+        } else
+        if (header_is(p, eol, "Connection"))
+        {
+            const char *v = header_value(p, eol);
+            if (strncasecmp(v, "close", 5) == 0)
+                close = true;
+            else
+            if (strncasecmp(v, "keep-alive", 10) == 0)
+                close = false;
+        } else
+        if (header_is(p, eol, "Transfer-Encoding"))
+            return ERROR_PROTOCOL;  // todo: chunked bodies (Riak does not send them for keys)
+
+        p = eol + 1;
+    }
+
+    // body without length is terminated by closing of connection
+    if (!has_length && *status != 204 && *status != 304 && *status >= 200)
+        return ERROR_PROTOCOL;
+    if (length > MAX_MESSAGE)
+        return ERROR_PROTOCOL;
+
+    while (m_in_end - m_in_begin < hdr_size + length)
+        if (!fill())
+            return ERROR_COMMUNICATION;
+
+    *body = slice_t(m_in.data() + m_in_begin + hdr_size, length);
+    m_in_begin += hdr_size + length;
+    m_closing = close;
+
+    return OK;
+}
+
+void riak_http::exec_pipeline(op_t *ops, size_t count)
+{
+    // server closed connection after the previous response
+    if (m_closing)
+        connect(m_connect_timeout_ms);
+
+    m_out.clear();
+    for(size_t i = 0; i < count; i++)
+        add_request(ops[i]);
+
+    if (m_fd < 0 || !send_all())
+    {
+        for(size_t i = 0; i < count; i++)
+            ops[i].code = ERROR_COMMUNICATION;
+        return;
+    }
+
+    // responses come in order of requests
+    for(size_t i = 0; i < count; i++)
+    {
+        op_t& op = ops[i];
+
+        // the rest of requests will not be answered
+        if (m_closing)
+        {
+            op.code = ERROR_COMMUNICATION;
+            continue;
+        }
+
+        int status;
+        slice_t body;
+        op.code = read_response(&status, &body);
+        if (op.code != OK)
+        {
+            for(size_t j = i + 1; j < count; j++)
+                ops[j].code = op.code;
+            close();
+            return;
+        }
+
+        switch(op.type)
+        {
+        case op_t::PUT:
+            if (status != 200 && status != 201 && status != 204)
+                op.code = ERROR_RESPONSE;
+            break;
+        case op_t::GET:
+            // not found key is empty value
+            //  todo: siblings (300 Multiple Choices)?
+            if (status == 200 || status == 404)
+            {
+                if (status == 404)
+                    body = slice_t();
+                if (op.result)
+                    op.result->assign(body.data, body.size);
+                else
+                    m_view = body;
+            } else
+                op.code = ERROR_RESPONSE;
+            break;
+        case op_t::DELETE:
+            if (status != 200 && status != 204 && status != 404)
+                op.code = ERROR_RESPONSE;
+            break;
+        }
+    }
+}
+
+int riak_http::put_key(slice_t const& key, slice_t const& value)
+{
+    if (key.empty() || value.empty())
+        assert(!"put_key received empty pointer(s)");
+
+    op_t op = { op_t::PUT, key, value, 0, 0 };
+    exec_pipeline(&op, 1);
+    return op.code;
+}
+
+int riak_http::get_key(slice_t const& key, std::string *value)
+{
+    if (key.empty() || !value)
+        assert(!"get_key received empty pointer(s)");
+
+    op_t op = { op_t::GET, key, slice_t(), value, 0 };
+    exec_pipeline(&op, 1);
+    return op.code;
+}
+
+int riak_http::get_key_view(slice_t const& key, slice_t *value)
+{
+    if (key.empty() || !value)
+        assert(!"get_key received empty pointer(s)");
+
+    // body stays in m_in until the next request
+    m_view = slice_t();
+    op_t op = { op_t::GET, key, slice_t(), 0, 0 };
+    exec_pipeline(&op, 1);
+    *value = m_view;
+    return op.code;
+}
+
+int riak_http::del_key(slice_t const& key)
+{
+    if (key.empty())
+        assert(!"del_key received empty pointer(s)");
+
+    op_t op = { op_t::DELETE, key, slice_t(), 0, 0 };
+    exec_pipeline(&op, 1);
+    return op.code;
+}
+
+static bool registered = register_riak_backend("http",
+    [] (std::string const& host, int portnum) { return riak_iface_ptr( new riak_http(host, portnum) ); });
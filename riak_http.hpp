@@ -0,0 +1,67 @@
+#include "riak_iface.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Client of Riak HTTP API over one persistent (keep-alive) HTTP/1.1
+//  connection. exec_pipeline() writes all requests at once and then reads
+//  responses in order. Registered as "http" backend.
+class riak_http: public riak_iface {
+public:
+    // result codes
+    enum {
+        OK                  = 0,
+        ERROR_COMMUNICATION = -1,   // socket error, timeout or connection closed
+        ERROR_PROTOCOL      = -2,   // malformed response
+        ERROR_RESPONSE      = -3,   // unexpected HTTP status
+    };
+
+    riak_http(std::string host, int portnum);
+    ~riak_http();
+    bool connect(int timeout_ms);
+    bool reconnect();
+
+    int put_key(slice_t const& key, slice_t const& value);
+    int get_key(slice_t const& key, std::string *value);
+    int del_key(slice_t const& key);
+
+    // value points into response buffer
+    int get_key_view(slice_t const& key, slice_t *value);
+
+    void exec_pipeline(op_t *ops, size_t count);
+
+    bool is_error_code(int code);
+
+    void set_timeout(int timeout_ms);
+
+private:
+    void close();
+
+    // appends request for operation to m_out
+    void add_request(op_t const& op);
+    bool send_all();
+
+    // reads the next response, 'body' points into m_in and is valid
+    //  until the next call
+    int read_response(int *status, slice_t *body);
+    // reads more data into m_in, false on error or closed connection
+    bool fill();
+
+    std::string m_host;
+    int         m_port;
+    int         m_fd;
+    int         m_connect_timeout_ms;
+    int         m_timeout_ms;           // currently set on socket
+
+    // buffers are reused between requests
+    std::string       m_out;
+    std::vector<char> m_in;
+    size_t            m_in_begin;       // not parsed data is [m_in_begin, m_in_end)
+    size_t            m_in_end;
+
+    // server closes connection after the current response
+    bool              m_closing;
+
+    // value of the last GET without result buffer (see get_key_view)
+    slice_t           m_view;
+};
@@ -0,0 +1,92 @@
+#include "riak_iface.hpp"
+
+#include <map>
+#include <mutex>
+
+#include "exception.hpp"
+
+int riak_iface::get_key_view(slice_t const& key, slice_t *value)
+{
+    int result = get_key(key, &m_view);
+    *value = slice_t(m_view);
+    return result;
+}
+
+void riak_iface::exec_pipeline(op_t *ops, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        op_t& op = ops[i];
+        switch(op.type)
+        {
+        case op_t::PUT:
+            op.code = put_key(op.key, op.value);
+            break;
+        case op_t::GET:
+            op.code = get_key(op.key, op.result);
+            break;
+        case op_t::DELETE:
+            op.code = del_key(op.key);
+            break;
+        }
+
+        // connection is broken, the rest fails the same way
+        if (is_error_code(op.code))
+        {
+            for(size_t j = i + 1; j < count; j++)
+                ops[j].code = op.code;
+            break;
+        }
+    }
+}
+
+// registry is created on first use, so backends can register
+//  themselves during static initialization
+static std::map<std::string, riak_factory_t>& registry()
+{
+    static std::map<std::string, riak_factory_t> backends;
+    return backends;
+}
+
+static std::mutex& registry_mutex()
+{
+    static std::mutex m;
+    return m;
+}
+
+bool register_riak_backend(std::string const& name, riak_factory_t const& factory)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    return registry().insert(std::make_pair(name, factory)).second;
+}
+
+std::vector<std::string> riak_backend_names()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex());
+
+    std::vector<std::string> r;
+    for(auto const& b : registry())
+        r.push_back(b.first);
+    return r;
+}
+
+bool is_riak_backend(std::string const& name)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    return registry().count(name) != 0;
+}
+
+riak_iface_ptr create_riak_instance(std::string const& backend, std::string const& host, int portnum)
+{
+    riak_factory_t factory;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+
+        auto it = registry().find(backend);
+        if (it == registry().end())
+            throw Exception("Unknown Riak backend <" + backend + ">");
+        factory = it->second;
+    }
+
+    return factory(host, portnum);
+}
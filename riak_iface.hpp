@@ -3,20 +3,70 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <functional>
+
+#include "slice.hpp"
 
 class riak_iface {
 public:
     virtual ~riak_iface() {};
+    // the first connection to node, socket operations
+    //  (including handshake) are limited by timeout (0 - no limit)
+    virtual bool connect(int timeout_ms) = 0;
     virtual bool reconnect() = 0;
     
-    virtual int put_key(std::string const& key, std::string const& value) = 0;
-    virtual int get_key(std::string const& key, std::string *value) = 0;
-    virtual int del_key(std::string const& key) = 0;
+    // key and value are only used during the call (no copies are kept)
+    virtual int put_key(slice_t const& key, slice_t const& value) = 0;
+    // value is assigned to caller's buffer (its capacity is reused),
+    //  it is empty if key is not found
+    virtual int get_key(slice_t const& key, std::string *value) = 0;
+    virtual int del_key(slice_t const& key) = 0;
+
+    // GET without copying of value: it points into client's own buffer
+    //  and is valid until the next call of this client.
+    //  Default implementation does get_key() into such buffer
+    virtual int get_key_view(slice_t const& key, slice_t *value);
 
     virtual bool is_error_code(int code) = 0;
+
+    // limits time of following operations on the wire, ms (0 - no limit)
+    virtual void set_timeout(int timeout_ms) {}
+
+    // operation of pipeline (see exec_pipeline)
+    struct op_t {
+        enum type_e {
+            PUT = 0,
+            GET,
+            DELETE,
+        };
+        type_e       type;
+        slice_t      key;
+        slice_t      value;     // PUT only
+        std::string *result;    // GET only
+        int          code;      // filled by exec_pipeline
+    };
+
+    // executes several operations, backend may send all of them before
+    //  reading replies. Default implementation executes them one by one
+    virtual void exec_pipeline(op_t *ops, size_t count);
+
+private:
+    std::string m_view;     // see get_key_view
 };
 typedef std::shared_ptr<riak_iface> riak_iface_ptr;
 
-riak_iface_ptr create_riak_instance(std::string host, int portnum);
+// Registry of client libraries (backends) implementing riak_iface.
+//  Backend registers itself from its source file:
+//      static bool registered = register_riak_backend("name", factory);
+typedef std::function<riak_iface_ptr(std::string const& host, int portnum)> riak_factory_t;
+
+bool register_riak_backend(std::string const& name, riak_factory_t const& factory);
+std::vector<std::string> riak_backend_names();
+bool is_riak_backend(std::string const& name);
+
+// creates client of given backend which is not connected yet
+//  (see riak_iface::connect), throws if there is no such backend
+riak_iface_ptr create_riak_instance(std::string const& backend, std::string const& host, int portnum);
 
 #endif //RIAK_IFACE_HPP
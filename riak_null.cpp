@@ -0,0 +1,64 @@
+#include "riak_null.hpp"
+
+#include <mutex>
+#include <unordered_map>
+#include <functional>
+
+// storage is split into shards to keep lock contention low
+static const size_t SHARDS = 64;
+
+struct shard_t {
+    std::mutex                                   mutex;
+    std::unordered_map<std::string, std::string> values;
+};
+
+static shard_t& shard_of(std::string const& key)
+{
+    static shard_t shards[SHARDS];
+    return shards[std::hash<std::string>()(key) % SHARDS];
+}
+
+// key of lookup, its buffer is reused by thread
+static std::string& key_of(slice_t const& key)
+{
+    static thread_local std::string k;
+    k.assign(key.data, key.size);
+    return k;
+}
+
+int riak_null::put_key(slice_t const& key, slice_t const& value)
+{
+    std::string& k = key_of(key);
+    shard_t& s = shard_of(k);
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.values[k].assign(value.data, value.size);
+    return 0;
+}
+
+int riak_null::get_key(slice_t const& key, std::string *value)
+{
+    std::string& k = key_of(key);
+    shard_t& s = shard_of(k);
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.values.find(k);
+    if (it != s.values.end())
+        value->assign(it->second);
+    else
+        value->clear();
+    return 0;
+}
+
+int riak_null::del_key(slice_t const& key)
+{
+    std::string& k = key_of(key);
+    shard_t& s = shard_of(k);
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.values.erase(k);
+    return 0;
+}
+
+static bool registered = register_riak_backend("null",
+    [] (std::string const&, int) { return riak_iface_ptr( new riak_null() ); });
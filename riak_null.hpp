@@ -0,0 +1,18 @@
+#include "riak_iface.hpp"
+
+// Loopback backend: keeps values in process memory shared by all its
+//  clients, so GET returns what PUT wrote. Measures overhead of tester
+//  itself without network and client library. Registered as "null".
+class riak_null: public riak_iface {
+public:
+    riak_null() {}
+
+    bool connect(int timeout_ms) { return true; }
+    bool reconnect() { return true; }
+
+    int put_key(slice_t const& key, slice_t const& value);
+    int get_key(slice_t const& key, std::string *value);
+    int del_key(slice_t const& key);
+
+    bool is_error_code(int code) { return code != 0; }
+};
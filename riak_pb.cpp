@@ -0,0 +1,381 @@
+#include "riak_pb.hpp"
+
+#include <cstring>
+#include <cassert>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+// message codes of Riak PB API
+enum {
+    MSG_ERROR_RESP = 0,
+    MSG_GET_REQ    = 9,
+    MSG_GET_RESP   = 10,
+    MSG_PUT_REQ    = 11,
+    MSG_PUT_RESP   = 12,
+    MSG_DEL_REQ    = 13,
+    MSG_DEL_RESP   = 14,
+};
+
+// protobuf wire types
+enum {
+    WIRE_VARINT = 0,
+    WIRE_64BIT  = 1,
+    WIRE_LEN    = 2,
+    WIRE_32BIT  = 5,
+};
+
+static const char BUCKET[]       = "test";
+static const char CONTENT_TYPE[] = "text/plain";
+
+// max size of response we agree to read
+static const uint32_t MAX_MESSAGE = 64 * 1024 * 1024;
+
+////////////////////////////////////////////////////////////////////////////////
+// Encoding
+static void put_varint(std::string& out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out += char(v | 0x80);
+        v >>= 7;
+    }
+    out += char(v);
+}
+
+static size_t varint_size(uint64_t v)
+{
+    size_t n = 1;
+    while (v >= 0x80)
+    {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static void put_bytes(std::string& out, int field, const char *data, size_t size)
+{
+    put_varint(out, (field << 3) | WIRE_LEN);
+    put_varint(out, size);
+    out.append(data, size);
+}
+
+// frame header is filled when message is complete
+static void begin_message(std::string& out)
+{
+    out.assign(5, '\0');
+}
+
+static void end_message(std::string& out, uint8_t code)
+{
+    uint32_t len = out.size() - 4;
+    out[0] = char(len >> 24);
+    out[1] = char(len >> 16);
+    out[2] = char(len >> 8);
+    out[3] = char(len);
+    out[4] = char(code);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Decoding: fields are returned as views into response buffer
+struct pb_reader_t {
+    const char *p;
+    const char *end;
+
+    pb_reader_t(const char *a_p, const char *a_end): p(a_p), end(a_end) {}
+
+    bool varint(uint64_t *v)
+    {
+        *v = 0;
+        for(int shift = 0; p < end && shift < 64; shift += 7)
+        {
+            uint8_t b = *p++;
+            *v |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    // next field; for length-delimited fields 'data' points to its body
+    //  returns false at the end of message or if it is malformed
+    bool next(int *field, int *wire, slice_t *data)
+    {
+        uint64_t tag;
+        if (p >= end || !varint(&tag))
+            return false;
+
+        *field = int(tag >> 3);
+        *wire  = int(tag & 7);
+
+        uint64_t v;
+        switch(*wire)
+        {
+        case WIRE_VARINT:
+            return varint(&v);
+        case WIRE_64BIT:
+            p += 8;
+            return p <= end;
+        case WIRE_32BIT:
+            p += 4;
+            return p <= end;
+        case WIRE_LEN:
+            if (!varint(&v) || v > uint64_t(end - p))
+                return false;
+            *data = slice_t(p, v);
+            p += v;
+            return true;
+        }
+        return false;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+riak_pb::riak_pb(std::string host, int portnum)
+    : m_host(host)
+    , m_port(portnum)
+    , m_fd(-1)
+    , m_connect_timeout_ms(0)
+    , m_timeout_ms(0)
+{
+}
+
+riak_pb::~riak_pb()
+{
+    close();
+}
+
+void riak_pb::close()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+}
+
+bool riak_pb::connect(int timeout_ms)
+{
+    close();
+    m_connect_timeout_ms = timeout_ms;
+
+    addrinfo hints, *res = 0;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(m_host.c_str(), std::to_string(m_port).c_str(), &hints, &res) != 0)
+        return false;
+
+    for(addrinfo *ai = res; ai && m_fd < 0; ai = ai->ai_next)
+    {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        // non-blocking connect is limited by timeout
+        int rc = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (rc != 0 && errno == EINPROGRESS)
+        {
+            pollfd pfd = { fd, POLLOUT, 0 };
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (poll(&pfd, 1, timeout_ms > 0 ? timeout_ms : -1) == 1
+                && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0)
+                rc = 0;
+        }
+
+        if (rc != 0)
+        {
+            ::close(fd);
+            continue;
+        }
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        m_fd = fd;
+    }
+    freeaddrinfo(res);
+
+    if (m_fd < 0)
+        return false;
+
+    m_timeout_ms = -1;
+    set_timeout(timeout_ms);
+    return true;
+}
+
+bool riak_pb::reconnect()
+{
+    return connect(m_connect_timeout_ms);
+}
+
+void riak_pb::set_timeout(int timeout_ms)
+{
+    if (timeout_ms == m_timeout_ms || m_fd < 0)
+        return;
+
+    struct timeval tv;
+    tv.tv_sec  = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    if (setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0
+        && setsockopt(m_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == 0)
+        m_timeout_ms = timeout_ms;
+}
+
+bool riak_pb::is_error_code(int code)
+{
+    // connection state is unknown after these errors
+    return code == ERROR_COMMUNICATION || code == ERROR_PROTOCOL;
+}
+
+int riak_pb::exchange(uint8_t req_code, uint8_t resp_code)
+{
+    if (m_fd < 0)
+        return ERROR_COMMUNICATION;
+
+    end_message(m_out, req_code);
+
+    for(size_t sent = 0; sent < m_out.size(); )
+    {
+        ssize_t n = send(m_fd, m_out.data() + sent, m_out.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return ERROR_COMMUNICATION;
+        }
+        sent += n;
+    }
+
+    // response: <uint32 length><uint8 code><payload>
+    auto read_exact = [this] (char *buf, size_t size) -> bool
+        {
+            for(size_t got = 0; got < size; )
+            {
+                ssize_t n = recv(m_fd, buf + got, size - got, 0);
+                if (n <= 0)
+                {
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    return false;
+                }
+                got += n;
+            }
+            return true;
+        };
+
+    unsigned char hdr[5];
+    if (!read_exact((char*)hdr, sizeof(hdr)))
+        return ERROR_COMMUNICATION;
+
+    uint32_t len = (uint32_t(hdr[0]) << 24) | (uint32_t(hdr[1]) << 16) | (uint32_t(hdr[2]) << 8) | hdr[3];
+    if (len == 0 || len > MAX_MESSAGE)
+        return ERROR_PROTOCOL;
+
+    m_in.resize(len - 1);
+    if (!m_in.empty() && !read_exact(m_in.data(), m_in.size()))
+        return ERROR_COMMUNICATION;
+
+    if (hdr[4] == MSG_ERROR_RESP)
+        return ERROR_RESPONSE;
+    if (hdr[4] != resp_code)
+        return ERROR_PROTOCOL;
+
+    return OK;
+}
+
+int riak_pb::put_key(slice_t const& key, slice_t const& value)
+{
+    if (key.empty() || value.empty())
+        assert(!"put_key received empty pointer(s)");
+
+    // RpbPutReq { bucket = 1; key = 2; content = 4 { value = 1; content_type = 2 } }
+    size_t content_size = 1 + varint_size(value.size) + value.size
+                        + 1 + varint_size(sizeof(CONTENT_TYPE) - 1) + sizeof(CONTENT_TYPE) - 1;
+
+    begin_message(m_out);
+    put_bytes(m_out, 1, BUCKET, sizeof(BUCKET) - 1);
+    put_bytes(m_out, 2, key.data, key.size);
+    put_varint(m_out, (4 << 3) | WIRE_LEN);
+    put_varint(m_out, content_size);
+    put_bytes(m_out, 1, value.data, value.size);
+    put_bytes(m_out, 2, CONTENT_TYPE, sizeof(CONTENT_TYPE) - 1);
+
+    return exchange(MSG_PUT_REQ, MSG_PUT_RESP);
+}
+
+int riak_pb::get_key(slice_t const& key, std::string *value)
+{
+    if (!value)
+        assert(!"get_key received empty pointer(s)");
+
+    slice_t v;
+    int result = get_key_view(key, &v);
+    value->assign(v.data, v.size);
+    return result;
+}
+
+int riak_pb::get_key_view(slice_t const& key, slice_t *value)
+{
+    if (key.empty() || !value)
+        assert(!"get_key received empty pointer(s)");
+
+    // RpbGetReq { bucket = 1; key = 2 }
+    begin_message(m_out);
+    put_bytes(m_out, 1, BUCKET, sizeof(BUCKET) - 1);
+    put_bytes(m_out, 2, key.data, key.size);
+
+    *value = slice_t();
+    int result = exchange(MSG_GET_REQ, MSG_GET_RESP);
+    if (result != OK)
+        return result;
+
+    // RpbGetResp { repeated content = 1 { value = 1 } }, empty if not found
+    //  todo: conflict resolution? (the first sibling is taken)
+    pb_reader_t resp(m_in.data(), m_in.data() + m_in.size());
+    int field, wire;
+    slice_t data;
+    while (resp.next(&field, &wire, &data))
+    {
+        if (field != 1 || wire != WIRE_LEN)
+            continue;
+
+        pb_reader_t content(data.data, data.data + data.size);
+        slice_t v;
+        while (content.next(&field, &wire, &v))
+            if (field == 1 && wire == WIRE_LEN)
+            {
+                *value = v;
+                return OK;
+            }
+        return OK;
+    }
+
+    return OK;
+}
+
+int riak_pb::del_key(slice_t const& key)
+{
+    if (key.empty())
+        assert(!"del_key received empty pointer(s)");
+
+    // RpbDelReq { bucket = 1; key = 2 }
+    begin_message(m_out);
+    put_bytes(m_out, 1, BUCKET, sizeof(BUCKET) - 1);
+    put_bytes(m_out, 2, key.data, key.size);
+
+    return exchange(MSG_DEL_REQ, MSG_DEL_RESP);
+}
+
+static bool registered = register_riak_backend("pb",
+    [] (std::string const& host, int portnum) { return riak_iface_ptr( new riak_pb(host, portnum) ); });
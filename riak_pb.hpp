@@ -0,0 +1,50 @@
+#include "riak_iface.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Minimal client of Riak Protocol Buffers API over plain socket
+//  (messages are encoded by hand, no protobuf library is needed).
+//  Registered as "pb" backend.
+class riak_pb: public riak_iface {
+public:
+    // result codes
+    enum {
+        OK                  = 0,
+        ERROR_COMMUNICATION = -1,   // socket error or timeout
+        ERROR_PROTOCOL      = -2,   // malformed or unexpected response
+        ERROR_RESPONSE      = -3,   // Riak returned RpbErrorResp
+    };
+
+    riak_pb(std::string host, int portnum);
+    ~riak_pb();
+    bool connect(int timeout_ms);
+    bool reconnect();
+
+    int put_key(slice_t const& key, slice_t const& value);
+    int get_key(slice_t const& key, std::string *value);
+    int del_key(slice_t const& key);
+
+    // value points into response buffer
+    int get_key_view(slice_t const& key, slice_t *value);
+
+    bool is_error_code(int code);
+
+    void set_timeout(int timeout_ms);
+
+private:
+    void close();
+
+    // sends request in m_out, receives response payload into m_in
+    int exchange(uint8_t req_code, uint8_t resp_code);
+
+    std::string m_host;
+    int         m_port;
+    int         m_fd;
+    int         m_connect_timeout_ms;
+    int         m_timeout_ms;           // currently set on socket
+
+    // buffers are reused between requests
+    std::string       m_out;
+    std::vector<char> m_in;
+};
@@ -6,6 +6,8 @@ extern "C" {
 
 #include <cstring>
 #include <cassert>
+#include <sys/socket.h>
+#include <sys/time.h>
 
 #include "exception.hpp"
 
@@ -37,30 +39,61 @@ struct riack_string_wrap: public riack_string {
     };
 };
 
+// key is passed to riack without copying
+//  (Note: const cast is Ok here - riack does not change it)
+static riack_string key_ref(slice_t const& key)
+{
+    riack_string r;
+    r.value = const_cast<char*>(key.data);
+    r.len   = key.size;
+    return r;
+}
+
 struct context_t {
     riack_client      *client;
 
     riack_string_wrap  content_type;
     riack_string_wrap  bucket;
+
+    // object of the last get_key_view (value points into it)
+    riack_get_object  *view;
 };
 
 riak::riak(std::string host, int portnum)
     : m_ctx( new context_t )
+    , m_host(host)
+    , m_port(portnum)
+    , m_connected(false)
+    , m_connect_timeout_ms(0)
+    , m_timeout_ms(0)
 {
     m_ctx->bucket       = riack_string_wrap("test");
     m_ctx->content_type = riack_string_wrap("text/plain");
+    m_ctx->view         = 0;
 
     riack_init();
 
     m_ctx->client = riack_new_client(0);
-    if (!m_ctx->client
-        || (riack_connect(m_ctx->client, host.c_str(), portnum, 0) != RIACK_SUCCESS))
+    if (!m_ctx->client)
     {
         cleanup();
         
-        throw Exception("Failed to connect to RIAK server using address <" + host + ":" + std::to_string(portnum) + ">");
+        throw Exception("Failed to create RIAK client for address <" + host + ":" + std::to_string(portnum) + ">");
     }
+}
+
+bool riak::connect(int timeout_ms)
+{
+    // socket timeouts also bound connection handshake
+    riack_connection_options options {0};
+    options.recv_timeout_ms = timeout_ms;
+    options.send_timeout_ms = timeout_ms;
 
+    m_connect_timeout_ms = timeout_ms;
+    m_timeout_ms = timeout_ms;
+
+    m_connected = (riack_connect(m_ctx->client, m_host.c_str(), m_port, timeout_ms ? &options : 0) == RIACK_SUCCESS);
+    return m_connected;
 }
 
 riak::~riak()
@@ -70,6 +103,8 @@ riak::~riak()
 
 void riak::cleanup()
 {
+    if (m_ctx->view)
+        riack_free_get_object_p(m_ctx->client, &m_ctx->view);
     riack_free(m_ctx->client);
 	riack_cleanup();
 
@@ -78,10 +113,32 @@ void riak::cleanup()
 
 bool riak::reconnect()
 {
+    // client which never connected has nothing to reconnect
+    if (!m_connected)
+        return connect(m_connect_timeout_ms);
+
+    // new socket gets timeouts of connection options
+    m_timeout_ms = m_connect_timeout_ms;
     return (riack_reconnect(m_ctx->client) == RIACK_SUCCESS);
 }
 
-int riak::put_key(std::string const& key, std::string const& value)
+void riak::set_timeout(int timeout_ms)
+{
+    if (timeout_ms == m_timeout_ms || m_ctx->client->sockfd < 0)
+        return;
+
+    struct timeval tv;
+    tv.tv_sec  = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    // riack uses blocking socket, so timed out operation fails
+    //  with communication error and client gets reconnected
+    if (setsockopt(m_ctx->client->sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0
+        && setsockopt(m_ctx->client->sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == 0)
+        m_timeout_ms = timeout_ms;
+}
+
+int riak::put_key(slice_t const& key, slice_t const& value)
 {
     if (key.empty() || value.empty())
         assert(!"put_key received empty pointer(s)");
@@ -97,47 +154,63 @@ int riak::put_key(std::string const& key, std::string const& value)
 
     // Note: these const casts are Ok here - this data is not changing inside riack_put
     object.bucket    = m_ctx->bucket;
-    object.key.value = const_cast<char*>(key.c_str());
-    object.key.len   = key.size();
+    object.key       = key_ref(key);
     object.content   = &content;
     
     content.content_type = m_ctx->content_type;
-    content.data     = (uint8_t*)(value.c_str());
-    content.data_len = value.size();
+    content.data     = (uint8_t*)(value.data);
+    content.data_len = value.size;
 
     return riack_put(m_ctx->client, &object, 0, 0);
 }
 
-int riak::get_key(std::string const& key, std::string *value)
+int riak::get_key(slice_t const& key, std::string *value)
+{
+    if (!value)
+        assert(!"get_key received empty pointer(s)");
+
+    slice_t v;
+    int result = get_key_view(key, &v);
+    value->assign(v.data, v.size);
+
+    // value is copied, object is not needed any more
+    riack_free_get_object_p(m_ctx->client, &m_ctx->view);
+
+    return result;
+}
+
+int riak::get_key_view(slice_t const& key, slice_t *value)
 {
     if (key.empty() || !value)
         assert(!"get_key received empty pointer(s)");
 
-	riack_get_object *obj = 0;
-	riack_string_wrap key_(key);
+    if (m_ctx->view)
+        riack_free_get_object_p(m_ctx->client, &m_ctx->view);
 
-    int result = riack_get(m_ctx->client, &m_ctx->bucket, &key_, 0, &obj);
+    riack_string key_ = key_ref(key);
+
+    *value = slice_t();
+    int result = riack_get(m_ctx->client, &m_ctx->bucket, &key_, 0, &m_ctx->view);
     if (result == RIACK_SUCCESS)
     {
         // todo: conflict resolution?
+        riack_get_object *obj = m_ctx->view;
         if (obj->object.content_count == 1
             && obj->object.content[0].data_len > 0)
         {
-            *value = std::string((const char*)obj->object.content[0].data, obj->object.content[0].data_len);
+            *value = slice_t((const char*)obj->object.content[0].data, obj->object.content[0].data_len);
         }
     }
 
-    riack_free_get_object_p(m_ctx->client, &obj);
-
-	return result;
+    return result;
 }
 
-int riak::del_key(std::string const& key)
+int riak::del_key(slice_t const& key)
 {
     if (key.empty())
         assert(!"del_key received empty pointer(s)");
-    
-	riack_string_wrap key_(key);
+
+    riack_string key_ = key_ref(key);
 
 	return riack_delete(m_ctx->client, &m_ctx->bucket, &key_, 0);
 }
@@ -147,7 +220,5 @@ bool riak::is_error_code(int code)
     return code == (RIACK_ERROR_COMMUNICATION) || (code == RIACK_FAILED_PB_UNPACK);
 }
 
-riak_iface_ptr create_riak_instance(std::string host, int portnum)
-{
-    return riak_iface_ptr( new riak(host, portnum) );
-}
+static bool registered = register_riak_backend("riack",
+    [] (std::string const& host, int portnum) { return riak_iface_ptr( new riak(host, portnum) ); });
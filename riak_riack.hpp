@@ -6,16 +6,27 @@ class riak: public riak_iface {
 public:
     riak(std::string addr, int portnum);
     ~riak();
+    bool connect(int timeout_ms);
     bool reconnect();
     
-    int put_key(std::string const& key, std::string const& value);
-    int get_key(std::string const& key, std::string *value);
-    int del_key(std::string const& key);
+    int put_key(slice_t const& key, slice_t const& value);
+    int get_key(slice_t const& key, std::string *value);
+    int del_key(slice_t const& key);
+
+    // value lives in riack's object until the next call
+    int get_key_view(slice_t const& key, slice_t *value);
 
     bool is_error_code(int code);
 
+    void set_timeout(int timeout_ms);
+
 private:
     void cleanup();
     
-    context_t *m_ctx;
+    context_t  *m_ctx;
+    std::string m_host;
+    int         m_port;
+    bool        m_connected;            // connect() succeeded at least once
+    int         m_connect_timeout_ms;
+    int         m_timeout_ms;           // currently set on socket
 };
@@ -0,0 +1,159 @@
+#include "shared_stats.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <sys/mman.h>
+
+#include "exception.hpp"
+
+struct shared_stats_t::impl_t {
+    // slots in shared memory
+    executor_stats_t *slots;
+    size_t            count;
+
+    // publishing (worker process)
+    size_t            slot;
+    stats_source_t    source;
+    double            interval_s;
+    executor_stats_t  local;        // the latest data from source
+
+    std::thread             thread;
+    std::mutex              mutex;
+    std::condition_variable cond;
+    bool                    running;
+
+    void worker();
+    void publish();
+};
+
+shared_stats_t::shared_stats_t(size_t slots)
+    : m_impl(new impl_t)
+{
+    m_impl->count   = slots;
+    m_impl->running = false;
+
+    void *mem = mmap(0, slots * sizeof(executor_stats_t), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        delete m_impl;
+        throw Exception(std::string("Failed to map shared memory: ") + strerror(errno));
+    }
+
+    // atomics of executor_stats_t are lock-free, so they work between processes
+    m_impl->slots = static_cast<executor_stats_t*>(mem);
+    for(size_t i = 0; i < slots; i++)
+        new (&m_impl->slots[i]) executor_stats_t;
+}
+
+shared_stats_t::~shared_stats_t()
+{
+    stop_publishing();
+
+    munmap(m_impl->slots, m_impl->count * sizeof(executor_stats_t));
+    delete m_impl;
+}
+
+size_t shared_stats_t::slots() const
+{
+    return m_impl->count;
+}
+
+void shared_stats_t::start_publishing(size_t slot, stats_source_t const& source, double interval_s)
+{
+    if (slot >= m_impl->count)
+        throw Exception("Invalid shared statistics slot " + std::to_string(slot));
+
+    m_impl->slot       = slot;
+    m_impl->source     = source;
+    m_impl->interval_s = interval_s > 0 ? interval_s : 0.1;
+    m_impl->running    = true;
+    m_impl->thread = std::thread(&impl_t::worker, m_impl);
+}
+
+void shared_stats_t::stop_publishing()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        if (!m_impl->running)
+            return;
+        m_impl->running = false;
+    }
+    m_impl->cond.notify_one();
+    m_impl->thread.join();
+
+    m_impl->publish();
+}
+
+void shared_stats_t::collect(executor_stats_t& dst)
+{
+    uint64_t ops[3] = { 0 }, errors[3] = { 0 }, timeouts[3] = { 0 }, hedges = 0, hedge_wins = 0,
+             retries = 0, failed = 0;
+
+    for(size_t s = 0; s < m_impl->count; s++)
+    {
+        executor_stats_t& st = m_impl->slots[s];
+        for(int i = 0; i < 3; i++)
+        {
+            ops[i]      += st.op[i].ops.load();
+            errors[i]   += st.op[i].errors.load();
+            timeouts[i] += st.op[i].timeouts.load();
+            st.op[i].latency.drain_to(dst.op[i].latency);
+            st.queue_delay[i].drain_to(dst.queue_delay[i]);
+        }
+        hedges     += st.hedges.load();
+        hedge_wins += st.hedge_wins.load();
+        retries    += st.retries.load();
+        failed     += st.failed.load();
+    }
+
+    for(int i = 0; i < 3; i++)
+    {
+        dst.op[i].ops.store(ops[i]);
+        dst.op[i].errors.store(errors[i]);
+        dst.op[i].timeouts.store(timeouts[i]);
+    }
+    dst.hedges.store(hedges);
+    dst.hedge_wins.store(hedge_wins);
+    dst.retries.store(retries);
+    dst.failed.store(failed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation goes here
+void shared_stats_t::impl_t::worker()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running)
+    {
+        if (cond.wait_for(lock, std::chrono::microseconds(uint64_t(interval_s * 1e6)),
+                          [this] { return !running; }))
+            break;
+
+        publish();
+    }
+}
+
+void shared_stats_t::impl_t::publish()
+{
+    source(local);
+
+    // histograms are moved, counters are cumulative
+    executor_stats_t& dst = slots[slot];
+    for(int i = 0; i < 3; i++)
+    {
+        dst.op[i].ops.store(local.op[i].ops.load());
+        dst.op[i].errors.store(local.op[i].errors.load());
+        dst.op[i].timeouts.store(local.op[i].timeouts.load());
+        local.op[i].latency.drain_to(dst.op[i].latency);
+        local.queue_delay[i].drain_to(dst.queue_delay[i]);
+    }
+    dst.hedges.store(local.hedges.load());
+    dst.hedge_wins.store(local.hedge_wins.load());
+    dst.retries.store(local.retries.load());
+    dst.failed.store(local.failed.load());
+}
@@ -0,0 +1,33 @@
+#ifndef SHARED_STATS_HPP
+#define SHARED_STATS_HPP
+
+#include <cstddef>
+
+#include "stats.hpp"
+
+// Statistics of worker processes in shared memory (see --processes).
+//  Every worker process owns one slot and periodically moves statistics
+//  of its executor there, coordinator reads all slots as one source:
+//  counters are summed and histograms are merged, so percentiles are exact.
+class shared_stats_t {
+public:
+    // memory is inherited by children, so it must be created before fork()
+    shared_stats_t(size_t slots);
+    ~shared_stats_t();
+
+    size_t slots() const;
+
+    // worker process: publishes 'source' into its slot every interval
+    void start_publishing(size_t slot, stats_source_t const& source, double interval_s);
+    // publishes the rest of data and stops
+    void stop_publishing();
+
+    // coordinator: sum of all slots (see stats_source_t)
+    void collect(executor_stats_t& dst);
+
+private:
+    struct impl_t;
+    impl_t *m_impl;
+};
+
+#endif //SHARED_STATS_HPP
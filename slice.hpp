@@ -0,0 +1,22 @@
+#ifndef SLICE_HPP
+#define SLICE_HPP
+
+#include <string>
+#include <cstring>
+
+// Non-owning view of a piece of memory (key or value).
+//  Memory must stay valid while slice is in use.
+struct slice_t {
+    const char *data;
+    size_t      size;
+
+    slice_t(): data(0), size(0) {}
+    slice_t(const char *a_data, size_t a_size): data(a_data), size(a_size) {}
+    slice_t(const char *str): data(str), size(strlen(str)) {}
+    slice_t(std::string const& str): data(str.data()), size(str.size()) {}
+
+    bool empty() const { return size == 0; }
+    std::string str() const { return std::string(data, size); }
+};
+
+#endif //SLICE_HPP
@@ -0,0 +1,140 @@
+#include "stage_trace.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+
+#include "exception.hpp"
+
+// samples per worker between two collect() calls
+static const size_t RING_SIZE = 8192;
+
+static const char* op_names[] = { "PUT", "GET", "DELETE" };
+
+// single writer (worker) and single reader (collect() under mutex)
+struct stage_tracer_t::ring_t {
+    std::atomic<uint64_t> head;     // written by worker
+    char                  pad[64];  // head and tail are on different cache lines
+    std::atomic<uint64_t> tail;     // written by reader
+    std::atomic<uint64_t> dropped;
+    stage_sample_t        samples[RING_SIZE];
+
+    ring_t(): head(0), tail(0), dropped(0) {}
+};
+
+stage_tracer_t::stage_tracer_t(size_t writers, size_t keep)
+    : m_keep(keep)
+    , m_samples(0)
+{
+    for(size_t i = 0; i < writers; i++)
+        m_rings.push_back(new ring_t);
+}
+
+stage_tracer_t::~stage_tracer_t()
+{
+    for(ring_t *r : m_rings)
+        delete r;
+}
+
+int64_t stage_tracer_t::now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* stage_tracer_t::span_name(int i)
+{
+    static const char* names[SPANS] = { "queue", "dispatch", "service", "callback" };
+    return (i >= 0 && i < SPANS) ? names[i] : "unknown";
+}
+
+void stage_tracer_t::push(size_t writer, stage_sample_t const& sample)
+{
+    ring_t& r = *m_rings[writer];
+
+    uint64_t head = r.head.load(std::memory_order_relaxed);
+    if (head - r.tail.load(std::memory_order_acquire) >= RING_SIZE)
+    {
+        r.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    r.samples[head % RING_SIZE] = sample;
+    r.head.store(head + 1, std::memory_order_release);
+}
+
+void stage_tracer_t::collect()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for(ring_t *r : m_rings)
+    {
+        uint64_t tail = r->tail.load(std::memory_order_relaxed);
+        uint64_t head = r->head.load(std::memory_order_acquire);
+        for(; tail != head; tail++)
+        {
+            stage_sample_t const& s = r->samples[tail % RING_SIZE];
+            for(int i = 0; i < SPANS; i++)
+                m_spans[i].record(s.ns[i + 1] > s.ns[i] ? s.ns[i + 1] - s.ns[i] : 0);
+
+            if (m_kept.size() < m_keep)
+                m_kept.push_back(s);
+        }
+        m_samples.fetch_add(head - r->tail.load(std::memory_order_relaxed));
+        r->tail.store(tail, std::memory_order_release);
+    }
+}
+
+uint64_t stage_tracer_t::dropped() const
+{
+    uint64_t r = 0;
+    for(ring_t const *ring : m_rings)
+        r += ring->dropped.load();
+    return r;
+}
+
+void stage_tracer_t::write_chrome_trace(std::string const& path)
+{
+    collect();
+
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+        throw Exception("Cannot create trace file <" + path + ">: " + strerror(errno));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // times are relative to the first sample, us
+    int64_t base = 0;
+    for(stage_sample_t const& s : m_kept)
+        if (base == 0 || s.ns[0] < base)
+            base = s.ns[0];
+    auto us = [base] (int64_t ns) { return (ns - base) / 1000.0; };
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(file, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"executor\"}}");
+    for(size_t w = 0; w < m_rings.size(); w++)
+        fprintf(file, ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, "
+                "\"args\": {\"name\": \"worker%zu\"}}", w, w);
+
+    for(size_t i = 0; i < m_kept.size(); i++)
+    {
+        stage_sample_t const& s = m_kept[i];
+        const char *op = s.op < 3 ? op_names[s.op] : "?";
+
+        // waiting operations overlap, so queue is shown as async event
+        fprintf(file, ",\n  {\"name\": \"%s queue\", \"cat\": \"queue\", \"ph\": \"b\", \"id\": %zu, "
+                "\"pid\": 1, \"tid\": %u, \"ts\": %.3f}", op, i, s.worker, us(s.ns[0]));
+        fprintf(file, ",\n  {\"name\": \"%s queue\", \"cat\": \"queue\", \"ph\": \"e\", \"id\": %zu, "
+                "\"pid\": 1, \"tid\": %u, \"ts\": %.3f}", op, i, s.worker, us(s.ns[1]));
+
+        for(int k = 1; k < SPANS; k++)
+            fprintf(file, ",\n  {\"name\": \"%s %s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, "
+                    "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"batch\": %u, \"attempts\": %u}}",
+                    op, span_name(k), span_name(k), s.worker, us(s.ns[k]),
+                    (s.ns[k + 1] - s.ns[k]) / 1000.0, unsigned(s.batch), unsigned(s.attempts));
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+}
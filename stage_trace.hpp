@@ -0,0 +1,73 @@
+#ifndef STAGE_TRACE_HPP
+#define STAGE_TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "histogram.hpp"
+
+// stages operation passes in executor
+enum class stage_e {
+    ENQUEUE = 0,    // caller put operation into queue
+    DEQUEUE,        // worker took it from queue
+    SEND,           // request is sent to node
+    RECEIVE,        // response is received
+    COMPLETE,       // completion callback returned
+};
+static const int STAGES = 5;
+
+// timestamps of one sampled operation
+struct stage_sample_t {
+    int64_t  ns[STAGES];    // steady clock, ns (indexed by stage_e)
+    uint8_t  op;            // op_e
+    uint8_t  attempts;      // failed attempts before the last one
+    uint16_t batch;         // operations sent in the same pipeline
+    uint32_t worker;
+};
+
+// Sampled per-stage tracing of executor operations.
+//  Every worker writes complete samples into its own ring buffer (single
+//  writer, no locks), collect() moves them into histograms of time between
+//  stages and keeps the first ones for Chrome trace.
+class stage_tracer_t {
+public:
+    // 'keep' - max number of samples written to Chrome trace
+    stage_tracer_t(size_t writers, size_t keep = 100000);
+    ~stage_tracer_t();
+
+    // worker 'writer' only; sample is dropped if ring is full
+    void push(size_t writer, stage_sample_t const& sample);
+
+    // may be called from any thread
+    void collect();
+
+    // time between stage i and i+1, ns (see span_name)
+    enum { SPANS = STAGES - 1 };
+    histogram_t const& span(int i) const { return m_spans[i]; }
+    static const char* span_name(int i);
+
+    uint64_t samples() const { return m_samples.load(); }
+    uint64_t dropped() const;
+
+    // kept samples as Chrome trace events (chrome://tracing, Perfetto):
+    //  queue wait is async event, the rest are spans on worker's track
+    void write_chrome_trace(std::string const& path);
+
+    static int64_t now_ns();
+
+private:
+    struct ring_t;
+    std::vector<ring_t*>        m_rings;
+
+    std::mutex                  m_mutex;        // collect() and kept samples
+    std::vector<stage_sample_t> m_kept;
+    size_t                      m_keep;
+
+    histogram_t                 m_spans[SPANS];
+    std::atomic<uint64_t>       m_samples;
+};
+
+#endif //STAGE_TRACE_HPP
@@ -0,0 +1,47 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+#include "histogram.hpp"
+
+// Statistics of one operation type.
+//  Updated from executor threads without locks.
+struct op_stats_t {
+    std::atomic<uint64_t> ops;      // completed operations
+    std::atomic<uint64_t> errors;   // failed attempts (communication errors)
+    std::atomic<uint64_t> timeouts; // dropped because of deadline
+
+    // latency from enqueue to completion, us.
+    //  Holds data since last drain (see reporter_t)
+    histogram_t           latency;
+
+    op_stats_t(): ops(0), errors(0), timeouts(0) {}
+};
+
+struct executor_stats_t {
+    // indexed by op_e
+    op_stats_t op[3];
+
+    // time commands spent in queue, us (indexed by priority_e)
+    histogram_t queue_delay[3];
+
+    // hedged GETs: duplicates sent and duplicates which answered first
+    std::atomic<uint64_t> hedges;
+    std::atomic<uint64_t> hedge_wins;
+
+    // failed attempts sent again, and operations given up
+    //  (see retry_opts_t and breaker_opts_t)
+    std::atomic<uint64_t> retries;
+    std::atomic<uint64_t> failed;
+
+    executor_stats_t(): hedges(0), hedge_wins(0), retries(0), failed(0) {}
+};
+
+// Fills 'dst' with cumulative counters and moves latencies collected
+//  since previous call into its histograms (see executor_t::collect_stats)
+typedef std::function<void(executor_stats_t& dst)> stats_source_t;
+
+#endif //STATS_HPP
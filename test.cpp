@@ -1,28 +1,29 @@
 #include <cassert>
 #include <cstring>
+#include <cerrno>
+#include <csignal>
 #include <string>
 #include <sstream>
+#include <memory>
 
 #include "exception.hpp"
 #include "cmd_executor.hpp"
 #include "logger.hpp"
 #include "utils.hpp"
+#include "loader.hpp"
+#include "replay.hpp"
+#include "trace.hpp"
+#include "reporter.hpp"
+#include "workload.hpp"
+#include "http_server.hpp"
+#include "rate_workload.hpp"
+#include "control.hpp"
+#include "shared_stats.hpp"
 
-#include <chrono>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-template<typename TimeT = std::chrono::milliseconds>
-struct measure
-{
-    template<typename F, typename ...Args>
-    static typename TimeT::rep execution(F func, Args&&... args)
-    {
-        auto start = std::chrono::system_clock::now();
-        func(std::forward<Args>(args)...);
-        auto duration = std::chrono::duration_cast< TimeT> 
-                            (std::chrono::system_clock::now() - start);
-        return duration.count();
-    }
-};
 ////////////////////////////////////
 
 // args:
@@ -32,57 +33,445 @@ struct measure
 //  value
 void print_usage()
 {
-    printf(R"XXX(
+    fputs(R"XXX(
 Usage:
-    test IP:port GET KEY
-    test IP:port PUT KEY VALUE
-    test IP:port DEL KEY
-    test IP:port TEST COUNT
+    test [options] IP:port GET KEY
+    test [options] IP:port PUT KEY VALUE
+    test [options] IP:port DEL KEY
+    test [options] IP:port TEST COUNT
+    test [options] IP:port LOAD FILE [FORMAT]
+    test [options] IP:port REPLAY TRACE
+    test [options] IP:port RUN SECONDS
+    test [options] COMPARE BASELINE CURRENT
+    test [options] SERVE IP:port
 
-IP:port - address of Riak node
-GET/PUT/DEL/TEST - operation
+IP:port - address of Riak node (comma-separated list for cluster)
+GET/PUT/DEL/TEST/LOAD/REPLAY/RUN - operation
 KEY     - key for the operation
 VALUE   - value for write
 COUNT   - number of PUT/GET/DEL operations to be performed
+FILE    - file with key/value records to be written
+FORMAT  - TSV (default): "key<TAB>value" lines
+          BIN: <uint32 key len><uint32 value len><key><value> records
+TRACE   - trace file written with --record option
+SECONDS - duration of RUN (mix of operations at target rate), 0 - until stopped
+          through control socket
+BASELINE, CURRENT - JSON results files (see --results) to compare
+SERVE   - run stand-in of Riak HTTP API (in-memory) for "http" backend
+
+Options:
+    --backend=B   client library: riack (default), pb (built-in Protocol Buffers client),
+                  http (built-in keep-alive HTTP client), null (in-process loopback);
+                  TEST accepts list "riack,pb,null" and prints comparison table
+    --workers=N   number of executor threads (default: 1)
+    --threads=N   LOAD: number of parser threads (default: 4)
+    --batch=N     LOAD: records per batch (default: 1000)
+    --record=FILE write trace of all operations to FILE
+    --speed=X     REPLAY: 1 - original timing (default), 2 - twice faster,
+                  0 - as fast as possible
+    --inflight=N  REPLAY/RUN: max number of operations in flight (default: 1000)
+    --rate=N      RUN: target rate, op/s (default: 0 - limited by --inflight only)
+    --mix=P,G,D   RUN: shares of PUT, GET and DELETE (default: 20,70,10)
+    --keys=N      RUN: number of keys operations go to (default: 10000)
+    --value-size=N  RUN: size of PUT value (default: 100)
+    --control=PATH  Unix socket to change settings of running test and query
+                  statistics (send "help" line for commands)
+    --max-workers=N  limit of workers which may be set through control socket
+                  (default: --workers)
+    --processes=N TEST/RUN: fork N processes with own executors, keys, COUNT, --rate
+                  and --inflight are divided between them; statistics are merged
+                  through shared memory and reported by parent process
+                  (--record and --trace-file get suffix ".<process number>")
+    --interval=S  TEST: reporting interval in seconds (default: 1)
+    --results=FILE  write interval statistics and run summary to FILE
+                  (.csv or .json), also enables reporting for LOAD/REPLAY
+    --threshold=P COMPARE: allowed difference from baseline, % (default: 10)
+    --warmup=N    TEST: warm-up with N operations (or N seconds if given as "Ns"),
+                  excluded from results
+    --iterations=N  TEST: number of repeated iterations (default: 1)
+    --pin-workers=CPUS      pin executor threads, CPUS is list of cores
+                            ("0-3,8", one core per thread) or NUMA node ("node:1")
+    --pin-reconnector=CPUS  pin executor Reconnector thread
+    --pin-load=CPUS         pin load generating threads (TEST/REPLAY main thread,
+                            LOAD parsers)
+    --max-cv=P    TEST: warn if results vary between iterations by more than P%
+                  (coefficient of variation, default: 10)
+    --balancer=P  node selection policy for cluster: first (default, fail-over only),
+                  round-robin, least-outstanding, ewma (latency-aware)
+    --hedge=D     duplicate GET to another node if it is not answered in D ms,
+                  or in time of percentile of recent GET latencies if given as "pN" (e.g. p95)
+    --hedge-budget=P  max number of hedged GETs, % of GETs (default: 5)
+    --max-attempts=N  attempts of operation failed with communication error
+                  (default: 0 - retried until it succeeds or times out)
+    --retry-budget=P  retries may add at most P% to traffic (default: 0 - no limit),
+                  operations which are not retried fail
+    --retry-same-node  retry on the node which failed (default: on another node)
+    --breaker=F[,MS[,P]]  circuit breaker: node which failed F times in a row gets
+                  no requests for MS ms (default: 1000), then P probes (default: 3)
+                  must succeed before it gets traffic again
+    --trace-stages=N  timestamp stages (queue, dispatch, service, callback) of one of N
+                  operations and print their latencies at the end
+    --trace-file=FILE  write sampled stages as Chrome trace (chrome://tracing, Perfetto)
+    --timeout=MS  time limit of every operation: operation which is not sent to Riak
+                  in time is dropped, the rest of time limits socket operations
+    --connect-timeout=MS  limit of connection to node (default: 1000), unreachable
+                  nodes are retried in background
+    --lazy-connect  connect to nodes when the first operation is issued
+    --lane-weights=I,N,B  shares of executor queue lanes: interactive (synchronous GETs),
+                  normal and bulk (LOAD) operations (default: 8,4,1)
+    --pipeline=N  send up to N queued operations to node without waiting for
+                  responses (default: 1, pipelining is done by http backend)
+    --dispatch=D  synchronous GETs (GET, TEST): queued (default, by executor threads) or
+                  inline (by calling thread on connection from per-node pool);
+                  TEST accepts list "queued,inline" and compares latency of both
+    --inline-conns=N  inline: connections to every node in pool (default: 4)
 
 Note: KEY and VALUE only used for 
-)XXX");
+)XXX", stdout);
 }
 
 enum OP {
     GET = 0,
     PUT,
     DEL,
-    TEST
+    TEST,
+    LOAD,
+    REPLAY,
+    RUN
 };
 
+test_opts_t parse_test_opts(options_t const& opts, std::string const& count)
+{
+    test_opts_t t_opts;
+    t_opts.count      = stoi(count);
+    t_opts.iterations = get_option_int(opts, "iterations", 1);
+    t_opts.max_cv_pct = get_option_double(opts, "max-cv", 10.0);
+
+    std::string warmup = get_option(opts, "warmup");
+    if (!warmup.empty() && warmup.back() == 's')
+        t_opts.warmup_s = std::stod(warmup);
+    else
+        t_opts.warmup_ops = get_option_int(opts, "warmup", 0);
+
+    return t_opts;
+}
+
+// "D" (ms), "pN" (percentile) or "off"
+void parse_hedge(std::string const& spec, hedge_opts_t& hedge)
+{
+    hedge.delay_ms   = 0;
+    hedge.percentile = 0;
+    if (spec.empty() || spec == "off")
+        return;
+
+    if (spec[0] == 'p')
+        hedge.percentile = std::stod(spec.substr(1));
+    else
+        hedge.delay_ms = std::stod(spec);
+}
+
+// "F[,MS[,P]]" - failures, open time and probes
+void parse_breaker(std::string const& spec, breaker_opts_t& breaker)
+{
+    if (spec.empty())
+        return;
+
+    strvector parts = split(spec, ',');
+    if (parts.size() > 3)
+        throw Exception("Invalid --breaker <" + spec + ">");
+
+    breaker.failures = std::stoul(parts[0]);
+    if (parts.size() > 1)
+        breaker.open_ms = std::stod(parts[1]);
+    if (parts.size() > 2)
+        breaker.probes = std::max<unsigned>(1, std::stoul(parts[2]));
+}
+
+std::string describe_hedge(hedge_opts_t const& hedge)
+{
+    char buf[64];
+    if (hedge.percentile > 0)
+        snprintf(buf, sizeof(buf), "p%g budget %g%%", hedge.percentile, hedge.budget_pct);
+    else
+    if (hedge.delay_ms > 0)
+        snprintf(buf, sizeof(buf), "%gms budget %g%%", hedge.delay_ms, hedge.budget_pct);
+    else
+        snprintf(buf, sizeof(buf), "off");
+    return buf;
+}
+
+// commands of control socket: settings of executor and RUN workload
+//  (workload may be null), statistics of the latest reporting interval
+void add_control_commands(control_t& control, executor_t& executor,
+                          rate_workload_t *workload, reporter_t *reporter)
+{
+    control.add("stats", "stats", [&executor, workload, reporter] (strvector const&, std::string& out)
+        {
+            if (reporter)
+                out += reporter->last_report();
+            out += "pending " + std::to_string(executor.pending()) + "\n";
+            if (workload)
+            {
+                rate_workload_t::state_t st = workload->state();
+                char buf[128];
+                snprintf(buf, sizeof(buf), "issued %llu inflight %zu throttled %llu lag %.3fs\n",
+                         (unsigned long long)st.issued, st.inflight,
+                         (unsigned long long)st.throttled, st.lag_s);
+                out += buf;
+            }
+        });
+
+    control.add("get", "get", [&executor, workload] (strvector const&, std::string& out)
+        {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "workers %zu\nhedge %s\ntimeout %g\n", executor.workers(),
+                     describe_hedge(executor.hedge()).c_str(), executor.timeout_ms());
+            out += buf;
+            if (workload)
+            {
+                rate_opts_t o = workload->opts();
+                snprintf(buf, sizeof(buf), "rate %g\ninflight %zu\nmix %u,%u,%u\n",
+                         o.rate, o.inflight, o.mix[0], o.mix[1], o.mix[2]);
+                out += buf;
+            }
+        });
+
+    control.add("set", "set workers|hedge|hedge-budget|timeout|rate|inflight|mix VALUE",
+                [&executor, workload, reporter] (strvector const& args, std::string& out)
+        {
+            if (args.size() != 3)
+                throw Exception("usage: set NAME VALUE");
+
+            std::string const& name  = args[1];
+            std::string const& value = args[2];
+            if (name == "workers")
+                out += "workers " + std::to_string(executor.set_workers(std::stoul(value))) + "\n";
+            else
+            if (name == "hedge" || name == "hedge-budget")
+            {
+                hedge_opts_t hedge = executor.hedge();
+                if (name == "hedge")
+                    parse_hedge(value, hedge);
+                else
+                    hedge.budget_pct = std::stod(value);
+                executor.set_hedge(hedge);
+            } else
+            if (name == "timeout")
+                executor.set_timeout(std::stod(value));
+            else
+            if (workload && name == "rate")
+                workload->set_rate(std::stod(value));
+            else
+            if (workload && name == "inflight")
+                workload->set_inflight(std::stoul(value));
+            else
+            if (workload && name == "mix")
+            {
+                strvector mix = split(value, ',');
+                if (mix.size() != 3)
+                    throw Exception("mix needs 3 values");
+                workload->set_mix(std::stoul(mix[0]), std::stoul(mix[1]), std::stoul(mix[2]));
+            } else
+                throw Exception("unknown setting <" + name + ">");
+
+            // settings are seen next to intervals they affect
+            if (reporter)
+                reporter->note("set " + name + " " + value);
+        });
+
+    if (workload)
+        control.add("stop", "stop", [workload] (strvector const&, std::string&)
+            {
+                workload->stop();
+            });
+}
+
+// latencies between stages of sampled operations
+void report_stages(stage_tracer_t& tracer, std::string const& path)
+{
+    tracer.collect();
+
+    printf("Stages (%llu sampled operations, %llu dropped):\n",
+           (unsigned long long)tracer.samples(), (unsigned long long)tracer.dropped());
+    for(int i = 0; i < stage_tracer_t::SPANS; i++)
+    {
+        histogram_t const& h = tracer.span(i);
+        printf("  %-9s mean %9.1f  p50 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us\n",
+               stage_tracer_t::span_name(i), h.mean() / 1000.0, h.percentile(50) / 1000.0,
+               h.percentile(99) / 1000.0, h.percentile(99.9) / 1000.0, h.max() / 1000.0);
+    }
+
+    if (!path.empty())
+    {
+        tracer.write_chrome_trace(path);
+        printf("Chrome trace is written to %s\n", path.c_str());
+    }
+}
+
+// metadata of results common for all operations
+void set_run_meta(reporter_t& reporter, strvector const& args, executor_opts_t const& ex_opts,
+                  options_t const& opts)
+{
+    reporter.set_meta("nodes", args[0]);
+    reporter.set_meta("workers", std::to_string(ex_opts.workers));
+    reporter.set_meta("backend", ex_opts.backend);
+    reporter.set_meta("workload", args[1] + " " + args[2] + (args.size() > 3 ? " " + args[3] : ""));
+    reporter.set_meta("balancer", balancer_t::policy_name(ex_opts.balancer));
+    if (ex_opts.dispatch != dispatch_e::QUEUED)
+        reporter.set_meta("dispatch", dispatch_name(ex_opts.dispatch));
+    if (ex_opts.timeout_ms > 0)
+        reporter.set_meta("timeout_ms", get_option(opts, "timeout"));
+    if (ex_opts.hedge.enabled())
+        reporter.set_meta("hedge", get_option(opts, "hedge") + " budget "
+                          + std::to_string(ex_opts.hedge.budget_pct) + "%");
+    if (ex_opts.retry.max_attempts > 0 || ex_opts.retry.budget_pct > 0)
+        reporter.set_meta("retry", "attempts " + std::to_string(ex_opts.retry.max_attempts)
+                          + " budget " + std::to_string(ex_opts.retry.budget_pct) + "%");
+    if (ex_opts.breaker.enabled())
+        reporter.set_meta("breaker", get_option(opts, "breaker"));
+}
+
+// parent of --processes: reports statistics of children until all of them exit
+int coordinate(shared_stats_t& shared, std::vector<pid_t> const& pids, strvector const& args,
+               executor_opts_t const& ex_opts, options_t const& opts)
+{
+    int failed = 0;
+    try {
+        reporter_t reporter([&shared] (executor_stats_t& dst) { shared.collect(dst); },
+                            get_option_double(opts, "interval", 1.0), get_option(opts, "results"));
+        set_run_meta(reporter, args, ex_opts, opts);
+        reporter.set_meta("processes", std::to_string(pids.size()));
+        reporter.start();
+
+        for(size_t i = 0; i < pids.size(); i++)
+        {
+            int status = 0;
+            while (waitpid(pids[i], &status, 0) < 0 && errno == EINTR)
+                ;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                printf("Process %zu (pid %d) failed with status %d\n", i, int(pids[i]), status);
+                failed++;
+            }
+        }
+
+        reporter.stop();
+    } catch (std::exception const& ex) {
+        printf("Exception: %s\n", ex.what());
+        return 1;
+    }
+
+    printf("%zu processes finished, %d failed\n", pids.size(), failed);
+    return failed ? 1 : 0;
+}
+
+// runs the same TEST workload with every backend and dispatch mode
+//  of synchronous GETs and prints comparison table
+int compare_backends(strvector const& addrs, executor_opts_t ex_opts,
+                     strvector const& backends, std::vector<dispatch_e> const& dispatches,
+                     test_opts_t const& t_opts)
+{
+    strvector names;
+    std::vector<test_result_t> results;
+    for(std::string const& backend : backends)
+        for(dispatch_e dispatch : dispatches)
+        {
+            std::string name = backend;
+            if (dispatches.size() > 1)
+                name += std::string("/") + dispatch_name(dispatch);
+            printf("=== Backend: %s\n", name.c_str());
+
+            ex_opts.backend = backend;
+            ex_opts.dispatch = dispatch;
+            executor_t executor(addrs, ex_opts);
+
+            test_workload_t workload(executor, t_opts);
+            workload.warmup();
+            workload.run();
+            names.push_back(name);
+            results.push_back(workload.result());
+
+            executor.stop(false);
+        }
+
+    printf("\n%-14s %10s %10s %10s %9s %9s %9s %9s %7s\n", "backend",
+           "PUT op/s", "GET op/s", "DEL op/s", "PUT p99", "GET p50", "GET p99", "DEL p99", "errors");
+    for(size_t i = 0; i < names.size(); i++)
+    {
+        test_result_t const& r = results[i];
+        printf("%-14s %10.0f %10.0f %10.0f %9.0f %9.0f %9.0f %9.0f %7i\n", names[i].c_str(),
+               r.rate[0], r.rate[1], r.rate[2], r.p99_us[0], r.p50_us[1], r.p99_us[1], r.p99_us[2],
+               r.errors);
+    }
+
+    return 0;
+}
+
 int
 main(int   argc,
      char *argv[])
 {
-    if (argc != 4 && argc != 5)
+    options_t opts;
+    strvector args = parse_args(argc, argv, &opts);
+
+    // stand-in server runs until it is killed
+    if (args.size() == 2 && strcasecmp(args[0].c_str(), "SERVE") == 0)
+    {
+        try {
+            setup_logger("riak_test", false);
+            http_server_t server(args[1]);
+            printf("Serving Riak HTTP API on %s\n", args[1].c_str());
+            server.run();
+        } catch (std::exception const& ex) {
+            printf("Exception: %s\n", ex.what());
+        }
+        return 1;
+    }
+
+    if (args.size() != 3 && args.size() != 4)
     {
         print_usage();
         return 1;
     }
+
+    // comparison of results does not need Riak at all
+    if (strcasecmp(args[0].c_str(), "COMPARE") == 0)
+    {
+        try {
+            return compare_results(args[1], args[2],
+                                   get_option_double(opts, "threshold", 10.0)) ? 2 : 0;
+        } catch (std::exception const& ex) {
+            printf("Exception: %s\n", ex.what());
+            return 1;
+        }
+    }
   
     int op = -1;
-    if (strcasecmp(argv[2], "GET") == 0)
+    if (strcasecmp(args[1].c_str(), "GET") == 0)
         op = GET;
     else
-    if (strcasecmp(argv[2], "PUT") == 0)
+    if (strcasecmp(args[1].c_str(), "PUT") == 0)
         op = PUT;
     else
-    if (strcasecmp(argv[2], "DEL") == 0)
+    if (strcasecmp(args[1].c_str(), "DEL") == 0)
         op = DEL;
     else
-    if (strcasecmp(argv[2], "TEST") == 0)
+    if (strcasecmp(args[1].c_str(), "TEST") == 0)
         op = TEST;
     else
+    if (strcasecmp(args[1].c_str(), "LOAD") == 0)
+        op = LOAD;
+    else
+    if (strcasecmp(args[1].c_str(), "REPLAY") == 0)
+        op = REPLAY;
+    else
+    if (strcasecmp(args[1].c_str(), "RUN") == 0)
+        op = RUN;
+    else
     ;
 
     // check and verify each address in addresses parameters
-    strvector addrs = split(argv[1], ',');
+    strvector addrs = split(args[0], ',');
     
     for (std::string addr : addrs)
     {
@@ -94,15 +483,215 @@ main(int   argc,
     }
 
     std::string
-        key = argv[3],
-        value = (argc == 5 ? argv[4] : "");
+        key = args[2],
+        value = (args.size() == 4 ? args[3] : "");
             
     setup_logger("riak_test", false);
     
+    executor_opts_t ex_opts;
+    placement_t load_cpus;
+    strvector backends;
+    std::vector<dispatch_e> dispatches;
+    try {
+        backends = split(get_option(opts, "backend", "riack"), ',');
+        if (backends.size() > 1 && op != TEST)
+            throw Exception("Several backends can only be compared by TEST");
+        ex_opts.backend = backends[0];
+
+        for(std::string const& d : split(get_option(opts, "dispatch", "queued"), ','))
+            dispatches.push_back(dispatch_by_name(d));
+        if (dispatches.size() > 1 && op != TEST)
+            throw Exception("Several dispatch modes can only be compared by TEST");
+        ex_opts.dispatch     = dispatches[0];
+        ex_opts.inline_conns = get_option_int(opts, "inline-conns", 4);
+
+        ex_opts.workers = get_option_int(opts, "workers", 1);
+        ex_opts.max_workers = get_option_int(opts, "max-workers", 0);
+        ex_opts.worker_cpus      = placement_t::parse(get_option(opts, "pin-workers"));
+        ex_opts.reconnector_cpus = placement_t::parse(get_option(opts, "pin-reconnector"));
+        load_cpus                = placement_t::parse(get_option(opts, "pin-load"));
+        if (!get_option(opts, "balancer").empty())
+            ex_opts.balancer = balancer_t::policy_by_name(get_option(opts, "balancer"));
+
+        parse_hedge(get_option(opts, "hedge"), ex_opts.hedge);
+        ex_opts.hedge.budget_pct = get_option_double(opts, "hedge-budget", 5.0);
+        ex_opts.timeout_ms       = get_option_double(opts, "timeout", 0);
+        ex_opts.connect_timeout_ms = get_option_double(opts, "connect-timeout", 1000);
+        ex_opts.lazy_connect       = !get_option(opts, "lazy-connect").empty();
+        ex_opts.pipeline           = get_option_int(opts, "pipeline", 1);
+
+        ex_opts.retry.max_attempts = get_option_int(opts, "max-attempts", 0);
+        ex_opts.retry.budget_pct   = get_option_double(opts, "retry-budget", 0);
+        ex_opts.retry.other_node   = get_option(opts, "retry-same-node").empty();
+        parse_breaker(get_option(opts, "breaker"), ex_opts.breaker);
+        ex_opts.trace_every = get_option_int(opts, "trace-stages", 0);
+        if (ex_opts.trace_every == 0 && !get_option(opts, "trace-file").empty())
+            throw Exception("--trace-file needs --trace-stages");
+
+        if (!get_option(opts, "lane-weights").empty())
+        {
+            ex_opts.lane_weights.clear();
+            for(std::string const& w : split(get_option(opts, "lane-weights"), ','))
+                ex_opts.lane_weights.push_back(std::stoul(w));
+            if (ex_opts.lane_weights.size() != 3)
+                throw Exception("--lane-weights needs 3 values");
+        }
+    } catch (std::exception const& ex) {
+        printf("%s\n", ex.what());
+        return 1;
+    }
+
+    if (backends.size() > 1 || dispatches.size() > 1)
+    {
+        try {
+            return compare_backends(addrs, ex_opts, backends, dispatches, parse_test_opts(opts, key));
+        } catch (std::exception const& ex) {
+            printf("Exception: %s\n", ex.what());
+            return 1;
+        }
+    }
+
+    // this process becomes coordinator of forked workers,
+    //  every worker runs the rest of main() with its part of keys
+    size_t processes = get_option_int(opts, "processes", 1);
+    size_t proc_index = 0;
+    std::unique_ptr<shared_stats_t> shared;
+    if (processes > 1)
+    {
+        std::vector<pid_t> pids;
+        try {
+            if (op != TEST && op != RUN)
+                throw Exception("--processes is supported by TEST and RUN only");
+            if (!get_option(opts, "control").empty())
+                throw Exception("--processes cannot be used with --control");
+
+            shared.reset(new shared_stats_t(processes));
+        } catch (std::exception const& ex) {
+            printf("%s\n", ex.what());
+            return 1;
+        }
+
+        // children must not repeat buffered output
+        fflush(stdout);
+
+        for(proc_index = 0; proc_index < processes; proc_index++)
+        {
+            pid_t pid = fork();
+            if (pid < 0)
+            {
+                printf("fork failed: %s\n", strerror(errno));
+                for(pid_t p : pids)
+                    kill(p, SIGTERM);
+                return 1;
+            }
+            if (pid == 0)
+                break;
+            pids.push_back(pid);
+        }
+
+        if (proc_index == processes)
+            return coordinate(*shared, pids, args, ex_opts, opts);
+
+        // output of workers is replaced by report of coordinator
+        if (!freopen("/dev/null", "w", stdout))
+            return 1;
+    }
+
     // create an executor to execute our Riak operations
-    executor_t executor(addrs);
+    executor_t executor(addrs, ex_opts);
+
+    // non-zero if some operations were not done
+    int exit_code = 0;
     
     try {
+        // executor threads are already created, so pinning of this thread
+        //  does not affect them
+        pin_current_thread(load_cpus.cpus_for(0));
+
+        std::string layout = executor.layout() + " load=" + describe_cpus(load_cpus.cpus);
+        if (!load_cpus.empty())
+            printf("Thread layout: %s\n", layout.c_str());
+
+        // recording of all operations issued to executor
+        std::unique_ptr<trace_writer_t> trace;
+        if (!get_option(opts, "record").empty())
+        {
+            // every worker process writes its own trace file
+            std::string path = get_option(opts, "record");
+            if (shared)
+                path += "." + std::to_string(proc_index);
+            trace.reset(new trace_writer_t(path));
+            executor.set_recorder(trace->recorder());
+        }
+
+        // warm-up goes before reporting so it is excluded from results
+        std::unique_ptr<test_workload_t> workload;
+        if (op == TEST)
+        {
+            test_opts_t t_opts = parse_test_opts(opts, key);
+            if (processes > 1)
+            {
+                t_opts.count = std::max<size_t>(1, t_opts.count / processes);
+                t_opts.key_prefix += std::to_string(proc_index) + "_";
+            }
+            workload.reset(new test_workload_t(executor, t_opts));
+            workload->warmup();
+        }
+
+        std::unique_ptr<rate_workload_t> rate_workload;
+        if (op == RUN)
+        {
+            rate_opts_t r_opts;
+            r_opts.duration_s = std::stod(key);
+            r_opts.rate       = get_option_double(opts, "rate", 0);
+            r_opts.inflight   = get_option_int(opts, "inflight", 1000);
+            r_opts.keys       = get_option_int(opts, "keys", 10000);
+            r_opts.value_size = get_option_int(opts, "value-size", 100);
+            if (!get_option(opts, "mix").empty())
+            {
+                strvector mix = split(get_option(opts, "mix"), ',');
+                if (mix.size() != 3)
+                    throw Exception("--mix needs 3 values");
+                for(int i = 0; i < 3; i++)
+                    r_opts.mix[i] = std::stoul(mix[i]);
+            }
+            if (processes > 1)
+            {
+                r_opts.keys      = std::max<size_t>(1, r_opts.keys / processes);
+                r_opts.first_key = proc_index * r_opts.keys;
+                r_opts.rate     /= processes;
+                r_opts.inflight  = std::max<size_t>(1, r_opts.inflight / processes);
+            }
+            rate_workload.reset(new rate_workload_t(executor, r_opts));
+        }
+
+        // time-series reporting of executor statistics
+        std::unique_ptr<reporter_t> reporter;
+        if (shared)
+            shared->start_publishing(proc_index,
+                                     [&executor] (executor_stats_t& dst) { executor.collect_stats(dst); },
+                                     0.1);
+        else
+        if (op == TEST || op == RUN || !get_option(opts, "results").empty()
+            || !get_option(opts, "control").empty())
+        {
+            reporter.reset(new reporter_t([&executor] (executor_stats_t& dst) { executor.collect_stats(dst); },
+                                          get_option_double(opts, "interval", 1.0),
+                                          get_option(opts, "results")));
+            set_run_meta(*reporter, args, ex_opts, opts);
+            reporter->set_meta("layout", layout);
+            reporter->start();
+        }
+
+        // settings of running test may be changed from outside
+        std::unique_ptr<control_t> control;
+        if (!get_option(opts, "control").empty())
+        {
+            control.reset(new control_t(get_option(opts, "control")));
+            add_control_commands(*control, executor, rate_workload.get(), reporter.get());
+            control->start();
+        }
+
         switch(op) {
         case GET:
             printf("GET returned: %s\n", executor.get_key(key).c_str());
@@ -115,71 +704,92 @@ main(int   argc,
             break;
         case TEST:
             // testing
+            workload->run();
+            break;
+        case RUN:
+            rate_workload->run();
+            break;
+        case LOAD:
         {
-            int count = stoi(key);
-            int seed = std::rand();
+            loader_t loader(key, value.empty() ? loader_t::format_e::TSV
+                                               : loader_t::format_by_name(value));
+            loader.set_placement(load_cpus);
 
-            // preparing keys and values
-            std::vector<std::string> keys, values;
-            for(int i = 0; i < count; i++)
-            {
-                keys.push_back(std::string("key") + std::to_string(seed + i));
-                values.push_back(std::string("value") + std::to_string(seed + i));
-            }
-            
-            int errors = 0;
-            
-            printf("Performing test for %i operations\n", count);
-            // create some amount of keys
-            int put_time = measure<>::execution(
-                [&executor, &keys, &values] () -> void
-                {
-                    for(int i = 0; i < keys.size(); i++)
-                        executor.put_key(keys[i], values[i]);
-                    executor.sync();
-                } );
-            
-            // read some amount of keys
-            int get_time = measure<>::execution(
-                [&executor, &keys, &values, &errors] () -> void
-                {
-                    for(int i = 0; i < keys.size(); i++)
-                    {
-                        if (values[i] != executor.get_key(keys[i]))
-                            errors++;
-                    }
-                    executor.sync();
-                } );
-
-            // delete created amount of keys
-            int del_time = measure<>::execution(
-                [&executor, &keys] () -> void
-                {
-                    for(int i = 0; i < keys.size(); i++)
-                        executor.del_key(keys[i]);
-                    executor.sync();
-                } );
-            
-            printf("Finished in %i seconds with %i erros\n", (put_time + get_time + del_time)/1000, errors );
-            printf("  PUT     : %i seconds\n", put_time/1000 );
-            printf("  GET     : %i seconds\n", get_time/1000 );
-            printf("  DELETE  : %i seconds\n", del_time/1000 );
-        }   
+            loader_t::result_t r = loader.run(executor,
+                                              get_option_int(opts, "threads", 4),
+                                              get_option_int(opts, "batch", 1000));
+
+            printf("Loaded %zu records (%.1f MB) in %.1f seconds, %zu skipped, %zu failed\n",
+                   r.records - r.failed, r.bytes / 1048576.0, r.seconds, r.skipped, r.failed);
+            if (r.seconds > 0)
+                printf("  %.0f records/s, %.1f MB/s\n",
+                       r.records / r.seconds, r.bytes / 1048576.0 / r.seconds);
+            if (r.failed > 0)
+                exit_code = 2;
+        }
+            break;
+        case REPLAY:
+        {
+            replayer_t replayer(key);
+
+            replayer_t::result_t r = replayer.run(executor,
+                                                  get_option_double(opts, "speed", 1.0),
+                                                  get_option_int(opts, "inflight", 1000));
+
+            printf("Replayed %llu operations in %.1f seconds (%.0f ops/s)\n",
+                   (unsigned long long)r.ops, r.seconds, r.seconds > 0 ? r.ops / r.seconds : 0.0);
+            printf("  latency p50 %llu us, p99 %llu us, p99.9 %llu us\n",
+                   (unsigned long long)r.p50_us, (unsigned long long)r.p99_us,
+                   (unsigned long long)r.p999_us);
+        }
             break;
         default:
             assert(!"Logical error: unknown RIAK operation");
         }
 
+        if (control)
+            control->stop();
+        if (shared)
+            shared->stop_publishing();
+        if (reporter)
+            reporter->stop();
+
+        // distribution of requests between nodes
+        std::vector<executor_t::node_info_t> nodes = executor.nodes();
+        if (nodes.size() > 1)
+        {
+            printf("Nodes (%s):\n", balancer_t::policy_name(ex_opts.balancer));
+            for(auto const& n : nodes)
+                printf("  %-21s selected %10llu  failures %6llu  ewma %8.0f us  breaker %s (opened %llu)\n",
+                       n.addr.c_str(), (unsigned long long)n.selected,
+                       (unsigned long long)n.failures, n.ewma_us,
+                       n.breaker, (unsigned long long)n.breaker_opened);
+        }
+
+        // where sampled operations spent their time
+        //  (every worker process writes its own trace file)
+        if (stage_tracer_t *tracer = executor.stage_tracer())
+        {
+            std::string path = get_option(opts, "trace-file");
+            if (shared && !path.empty())
+                path += "." + std::to_string(proc_index);
+            report_stages(*tracer, path);
+        }
+
     } catch (std::exception const& ex) {
         printf("Exception: %s\n", ex.what());
+        if (shared)
+            shared->stop_publishing();
         return 1;
     } catch (...) {
         printf("Unknown exception!");
+        if (shared)
+            shared->stop_publishing();
         return 1;
     }
 
     executor.stop(false);
 
-    return 0;
+    return exit_code;
 }
 
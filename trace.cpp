@@ -0,0 +1,172 @@
+#include "trace.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+
+#include "exception.hpp"
+
+static const char   TRACE_MAGIC[] = "RKTRACE1";
+static const size_t TRACE_MAGIC_LEN = 8;
+static const size_t TRACE_BUF_SIZE = 1 << 20;
+
+static uint64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void put_varint(std::vector<char>& buf, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        buf.push_back(char(v | 0x80));
+        v >>= 7;
+    }
+    buf.push_back(char(v));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+trace_writer_t::trace_writer_t(std::string const& path)
+    : m_file(fopen(path.c_str(), "wb"))
+    , m_records(0)
+{
+    if (!m_file)
+        throw Exception("Failed to create trace <" + path + ">: " + strerror(errno));
+
+    m_buf.reserve(TRACE_BUF_SIZE);
+    m_buf.insert(m_buf.end(), TRACE_MAGIC, TRACE_MAGIC + TRACE_MAGIC_LEN);
+
+    m_last_us = now_us();
+}
+
+trace_writer_t::~trace_writer_t()
+{
+    flush();
+    fclose(m_file);
+}
+
+void trace_writer_t::write(op_e op, slice_t const& key, size_t value_size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // time is taken under lock so deltas are never negative
+    uint64_t now = now_us();
+
+    m_buf.push_back(char(op));
+    put_varint(m_buf, now - m_last_us);
+    put_varint(m_buf, key.size);
+    put_varint(m_buf, value_size);
+    m_buf.insert(m_buf.end(), key.data, key.data + key.size);
+
+    m_last_us = now;
+    m_records++;
+
+    if (m_buf.size() >= TRACE_BUF_SIZE)
+    {
+        fwrite(m_buf.data(), 1, m_buf.size(), m_file);
+        m_buf.clear();
+    }
+}
+
+void trace_writer_t::flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    fwrite(m_buf.data(), 1, m_buf.size(), m_file);
+    m_buf.clear();
+    fflush(m_file);
+}
+
+recorder_t trace_writer_t::recorder()
+{
+    return [this] (op_e op, slice_t const& key, size_t value_size)
+        {
+            write(op, key, value_size);
+        };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+trace_reader_t::trace_reader_t(std::string const& path)
+    : m_file(fopen(path.c_str(), "rb"))
+    , m_buf(TRACE_BUF_SIZE)
+    , m_pos(0)
+    , m_end(0)
+    , m_last_us(0)
+{
+    if (!m_file)
+        throw Exception("Failed to open trace <" + path + ">: " + strerror(errno));
+
+    if (!fill(TRACE_MAGIC_LEN) || memcmp(m_buf.data() + m_pos, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0)
+    {
+        fclose(m_file);
+        throw Exception("File <" + path + "> is not a trace");
+    }
+    m_pos += TRACE_MAGIC_LEN;
+}
+
+trace_reader_t::~trace_reader_t()
+{
+    fclose(m_file);
+}
+
+// makes sure there are at least 'need' bytes in buffer
+bool trace_reader_t::fill(size_t need)
+{
+    if (m_end - m_pos >= need)
+        return true;
+
+    // move the rest to the beginning and read next piece
+    memmove(m_buf.data(), m_buf.data() + m_pos, m_end - m_pos);
+    m_end -= m_pos;
+    m_pos = 0;
+
+    if (need > m_buf.size())
+        m_buf.resize(need);
+
+    m_end += fread(m_buf.data() + m_end, 1, m_buf.size() - m_end, m_file);
+
+    return m_end - m_pos >= need;
+}
+
+bool trace_reader_t::read_varint(uint64_t *v)
+{
+    *v = 0;
+    for(int shift = 0; shift < 64; shift += 7)
+    {
+        if (!fill(1))
+            return false;
+
+        unsigned char c = m_buf[m_pos++];
+        *v |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+
+    throw Exception("Corrupted trace: varint is too long");
+}
+
+bool trace_reader_t::next(trace_record_t *rec)
+{
+    if (!fill(1))
+        return false;
+
+    unsigned char op = m_buf[m_pos++];
+    if (op > (unsigned char)op_e::DELETE)
+        throw Exception("Corrupted trace: unknown operation " + std::to_string(op));
+
+    uint64_t delta, key_len, value_size;
+    if (!read_varint(&delta) || !read_varint(&key_len) || !read_varint(&value_size)
+        || !fill(key_len))
+        throw Exception("Corrupted trace: truncated record");
+
+    m_last_us += delta;
+
+    rec->op           = op_e(op);
+    rec->timestamp_us = m_last_us;
+    rec->value_size   = value_size;
+    rec->key.assign(m_buf.data() + m_pos, key_len);
+
+    m_pos += key_len;
+    return true;
+}
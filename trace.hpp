@@ -0,0 +1,66 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdio>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cmd_executor.hpp"
+
+// Binary trace of Riak operations.
+//
+// File starts with 8 byte magic "RKTRACE1" followed by records:
+//  <uint8 op><varint time delta, us><varint key length><varint value size><key>
+// Time delta is counted from the previous record (from start for the first one).
+struct trace_record_t {
+    op_e        op;
+    uint64_t    timestamp_us;   // since start of recording
+    std::string key;
+    size_t      value_size;     // 0 for GET and DELETE
+};
+
+// Thread-safe trace writer, can be used as executor recorder:
+//  executor.set_recorder(writer.recorder());
+class trace_writer_t {
+public:
+    trace_writer_t(std::string const& path);
+    ~trace_writer_t();
+
+    void write(op_e op, slice_t const& key, size_t value_size);
+    void flush();
+
+    recorder_t recorder();
+
+    uint64_t records() const { return m_records; }
+
+private:
+    std::mutex         m_mutex;
+    FILE              *m_file;
+    std::vector<char>  m_buf;
+    uint64_t           m_last_us;
+    uint64_t           m_records;
+};
+
+// Reads trace sequentially with fixed size buffer (file is never loaded whole)
+class trace_reader_t {
+public:
+    trace_reader_t(std::string const& path);
+    ~trace_reader_t();
+
+    // returns false at end of file
+    bool next(trace_record_t *rec);
+
+private:
+    bool fill(size_t need);
+    bool read_varint(uint64_t *v);
+
+    FILE              *m_file;
+    std::vector<char>  m_buf;
+    size_t             m_pos;
+    size_t             m_end;
+    uint64_t           m_last_us;
+};
+
+#endif //TRACE_HPP
@@ -45,3 +45,58 @@ bool validate_address(std::string const& addr, std::string *a_host, int *a_port)
 
     return false;
 }
+
+std::vector<std::string> parse_args(int argc, char *argv[], options_t *opts)
+{
+    std::vector<std::string> positional;
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.size() <= 2 || arg.compare(0, 2, "--") != 0)
+        {
+            positional.push_back(arg);
+            continue;
+        }
+
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos)
+            (*opts)[arg.substr(2)] = "1";
+        else
+            (*opts)[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+    }
+
+    return positional;
+}
+
+std::string get_option(options_t const& opts, std::string const& name, std::string const& def)
+{
+    options_t::const_iterator it = opts.find(name);
+    return it == opts.end() ? def : it->second;
+}
+
+long get_option_int(options_t const& opts, std::string const& name, long def)
+{
+    options_t::const_iterator it = opts.find(name);
+    if (it == opts.end())
+        return def;
+
+    try {
+        return std::stol(it->second);
+    } catch (...) {
+        throw std::invalid_argument("Incorrect value of option --" + name + ": " + it->second);
+    }
+}
+
+double get_option_double(options_t const& opts, std::string const& name, double def)
+{
+    options_t::const_iterator it = opts.find(name);
+    if (it == opts.end())
+        return def;
+
+    try {
+        return std::stod(it->second);
+    } catch (...) {
+        throw std::invalid_argument("Incorrect value of option --" + name + ": " + it->second);
+    }
+}
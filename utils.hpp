@@ -3,9 +3,21 @@
 
 #include <string>
 #include <vector>
+#include <map>
 
 std::vector<std::string> const split(const std::string &s, char delim);
 
 bool validate_address(std::string const& addr, std::string *a_host = 0, int *a_port = 0);
 
+// command line options in form "--name=value" ("--name" means "--name=1")
+typedef std::map<std::string, std::string> options_t;
+
+// splits command line into positional arguments and options
+std::vector<std::string> parse_args(int argc, char *argv[], options_t *opts);
+
+// returns option value or default if option is not set
+std::string get_option(options_t const& opts, std::string const& name, std::string const& def = "");
+long get_option_int(options_t const& opts, std::string const& name, long def);
+double get_option_double(options_t const& opts, std::string const& name, double def);
+
 #endif //UTILS_HPP
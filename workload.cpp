@@ -0,0 +1,314 @@
+#include "workload.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "cmd_executor.hpp"
+#include "histogram.hpp"
+
+typedef std::chrono::steady_clock clock_type;
+
+static const char* op_names[] = { "PUT", "GET", "DELETE" };
+
+// metrics collected for every operation type in each iteration
+enum metric_e {
+    M_RATE = 0,
+    M_P50,
+    M_P99,
+    M_P999,
+    M_COUNT
+};
+static const char* metric_names[] = { "op/s", "p50 us", "p99 us", "p99.9 us" };
+
+static uint64_t us_since(clock_type::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - t).count();
+}
+
+// two-sided 95% quantile of Student's t-distribution
+static double t_975(size_t df)
+{
+    static const double table[] = {
+        0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if (df < sizeof(table) / sizeof(table[0]))
+        return table[df];
+    return 1.960;
+}
+
+struct summary_t {
+    double mean;
+    double stddev;
+    double ci95;    // half-width of 95% confidence interval of mean
+
+    double cv_pct() const { return mean != 0 ? stddev / mean * 100.0 : 0.0; }
+};
+
+static summary_t summarize(std::vector<double> const& v)
+{
+    summary_t s = { 0, 0, 0 };
+    if (v.empty())
+        return s;
+
+    for(double x : v)
+        s.mean += x;
+    s.mean /= v.size();
+
+    if (v.size() < 2)
+        return s;
+
+    double sq = 0;
+    for(double x : v)
+        sq += (x - s.mean) * (x - s.mean);
+    s.stddev = sqrt(sq / (v.size() - 1));
+    s.ci95   = t_975(v.size() - 1) * s.stddev / sqrt(double(v.size()));
+
+    return s;
+}
+
+struct test_workload_t::impl_t {
+    executor_t&  executor;
+    test_opts_t  opts;
+
+    int          seed;
+    size_t       next_key;      // keys are not reused between iterations
+    int          errors;        // of all iterations
+
+    // samples[op][metric] - one value per iteration
+    std::vector<double> samples[3][M_COUNT];
+
+    impl_t(executor_t& a_executor): executor(a_executor) {}
+
+    void make_keys(size_t count, std::vector<std::string> *keys, std::vector<std::string> *values);
+
+    // runs one phase, returns its duration in seconds
+    double run_phase(op_e op, std::vector<std::string> const& keys,
+                     std::vector<std::string> const& values,
+                     histogram_t& latency, int *errors);
+};
+
+test_workload_t::test_workload_t(executor_t& executor, test_opts_t const& opts)
+    : m_impl(new impl_t(executor))
+{
+    m_impl->opts     = opts;
+    m_impl->seed     = std::rand();
+    m_impl->next_key = 0;
+    m_impl->errors   = 0;
+
+    if (m_impl->opts.iterations == 0)
+        m_impl->opts.iterations = 1;
+}
+
+test_workload_t::~test_workload_t()
+{
+    delete m_impl;
+}
+
+void test_workload_t::warmup()
+{
+    if (m_impl->opts.warmup_ops == 0 && m_impl->opts.warmup_s <= 0)
+        return;
+
+    printf("Warming up...\n");
+
+    clock_type::time_point start = clock_type::now();
+    size_t batch = std::min<size_t>(m_impl->opts.count ? m_impl->opts.count : 1000, 1000);
+    size_t ops = 0;
+    int errors = 0;
+
+    for(;;)
+    {
+        if (m_impl->opts.warmup_ops && ops >= m_impl->opts.warmup_ops)
+            break;
+        if (m_impl->opts.warmup_s > 0 && us_since(start) >= m_impl->opts.warmup_s * 1e6)
+            break;
+
+        std::vector<std::string> keys, values;
+        m_impl->make_keys(batch, &keys, &values);
+
+        histogram_t latency;
+        m_impl->run_phase(op_e::PUT, keys, values, latency, &errors);
+        m_impl->run_phase(op_e::GET, keys, values, latency, &errors);
+        m_impl->run_phase(op_e::DELETE, keys, values, latency, &errors);
+
+        ops += 3 * batch;
+    }
+
+    printf("Warm-up: %zu operations in %.1f seconds (excluded from results)\n",
+           ops, us_since(start) / 1e6);
+}
+
+int test_workload_t::run()
+{
+    test_opts_t const& opts = m_impl->opts;
+    int total_errors = 0;
+    double total_seconds = 0;
+
+    printf("Performing test for %zu operations, %zu iteration(s)\n", opts.count, opts.iterations);
+
+    for(size_t it = 0; it < opts.iterations; it++)
+    {
+        std::vector<std::string> keys, values;
+        m_impl->make_keys(opts.count, &keys, &values);
+
+        histogram_t latency[3];
+        double seconds[3];
+        int errors = 0;
+
+        // create, read and delete keys
+        seconds[0] = m_impl->run_phase(op_e::PUT, keys, values, latency[0], &errors);
+        seconds[1] = m_impl->run_phase(op_e::GET, keys, values, latency[1], &errors);
+        seconds[2] = m_impl->run_phase(op_e::DELETE, keys, values, latency[2], &errors);
+
+        double it_seconds = seconds[0] + seconds[1] + seconds[2];
+        total_seconds += it_seconds;
+        total_errors  += errors;
+
+        printf("Iteration %zu/%zu: %.1f seconds, %i errors\n", it + 1, opts.iterations, it_seconds, errors);
+        for(int op = 0; op < 3; op++)
+        {
+            double rate = seconds[op] > 0 ? keys.size() / seconds[op] : 0;
+
+            m_impl->samples[op][M_RATE].push_back(rate);
+            m_impl->samples[op][M_P50].push_back(latency[op].percentile(50));
+            m_impl->samples[op][M_P99].push_back(latency[op].percentile(99));
+            m_impl->samples[op][M_P999].push_back(latency[op].percentile(99.9));
+
+            printf("  %-8s: %.1f seconds, %8.0f op/s, p50 %llu us, p99 %llu us, p99.9 %llu us\n",
+                   op_names[op], seconds[op], rate,
+                   (unsigned long long)latency[op].percentile(50),
+                   (unsigned long long)latency[op].percentile(99),
+                   (unsigned long long)latency[op].percentile(99.9));
+        }
+    }
+
+    printf("Finished in %.1f seconds with %i erros\n", total_seconds, total_errors);
+    m_impl->errors = total_errors;
+
+    if (opts.iterations < 2)
+        return total_errors;
+
+    // statistics between iterations
+    printf("Summary over %zu iterations (mean +- 95%% confidence interval):\n", opts.iterations);
+
+    std::vector<std::string> warnings;
+    for(int op = 0; op < 3; op++)
+        for(int m = 0; m < M_COUNT; m++)
+        {
+            summary_t s = summarize(m_impl->samples[op][m]);
+
+            printf("  %-6s %-9s %10.1f +- %-9.1f (stddev %.1f, cv %.1f%%)\n",
+                   op_names[op], metric_names[m], s.mean, s.ci95, s.stddev, s.cv_pct());
+
+            if (s.cv_pct() > opts.max_cv_pct)
+            {
+                char buf[256];
+                snprintf(buf, sizeof(buf), "%s %s varies by %.1f%% between iterations",
+                         op_names[op], metric_names[m], s.cv_pct());
+                warnings.push_back(buf);
+            }
+        }
+
+    for(std::string const& w : warnings)
+        printf("WARNING: %s (limit %.1f%%), results are not reliable\n", w.c_str(), opts.max_cv_pct);
+
+    return total_errors;
+}
+
+test_result_t test_workload_t::result() const
+{
+    test_result_t r;
+    for(int op = 0; op < 3; op++)
+    {
+        r.rate[op]   = summarize(m_impl->samples[op][M_RATE]).mean;
+        r.p50_us[op] = summarize(m_impl->samples[op][M_P50]).mean;
+        r.p99_us[op] = summarize(m_impl->samples[op][M_P99]).mean;
+    }
+    r.errors = m_impl->errors;
+    return r;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation goes here
+void test_workload_t::impl_t::make_keys(size_t count, std::vector<std::string> *keys,
+                                        std::vector<std::string> *values)
+{
+    for(size_t i = 0; i < count; i++, next_key++)
+    {
+        keys->push_back(opts.key_prefix + std::to_string(seed + next_key));
+        values->push_back(std::string("value") + std::to_string(seed + next_key));
+    }
+}
+
+double test_workload_t::impl_t::run_phase(op_e op, std::vector<std::string> const& keys,
+                                          std::vector<std::string> const& values,
+                                          histogram_t& latency, int *errors)
+{
+    clock_type::time_point start = clock_type::now();
+
+    // GETs are synchronous: caller checks the value
+    //  (it is read into one reused buffer)
+    if (op == op_e::GET)
+    {
+        std::string value;
+        for(size_t i = 0; i < keys.size(); i++)
+        {
+            clock_type::time_point issued = clock_type::now();
+            if (!executor.get_key(keys[i], &value) || values[i] != value)
+                (*errors)++;
+            latency.record(us_since(issued));
+        }
+
+        return us_since(start) / 1e6;
+    }
+
+    // PUTs and DELETEs are asynchronous: wait for all completions
+    std::atomic<size_t>     remaining(keys.size());
+    std::atomic<int>        timeouts(0);
+    std::mutex              mutex;
+    std::condition_variable cond;
+
+    // decrement is done under lock: waiter may return (and destroy
+    //  mutex and cond) as soon as it sees zero
+    auto complete = [&] ()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (remaining.fetch_sub(1) == 1)
+                cond.notify_all();
+        };
+
+    for(size_t i = 0; i < keys.size(); i++)
+    {
+        clock_type::time_point issued = clock_type::now();
+        done_cb_t cb = [&latency, &complete, &timeouts, issued] (status_e status, std::string const&)
+            {
+                if (status == status_e::OK)
+                    latency.record(us_since(issued));
+                else
+                    timeouts.fetch_add(1);
+                complete();
+            };
+
+        bool accepted = (op == op_e::PUT) ? executor.put_key(keys[i], values[i], cb)
+                                          : executor.del_key(keys[i], cb);
+        if (!accepted)
+        {
+            (*errors)++;
+            complete();
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&remaining] { return remaining.load() == 0; });
+
+    *errors += timeouts.load();
+    return us_since(start) / 1e6;
+}
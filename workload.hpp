@@ -0,0 +1,58 @@
+#ifndef WORKLOAD_HPP
+#define WORKLOAD_HPP
+
+#include <string>
+#include <vector>
+
+class executor_t;
+
+struct test_opts_t {
+    size_t  count;          // number of keys (operations of each type per iteration)
+    size_t  iterations;
+
+    // warm-up: runs until either limit is reached (0 - no limit)
+    size_t  warmup_ops;
+    double  warmup_s;
+
+    // max coefficient of variation between iterations (%) before warning
+    double  max_cv_pct;
+
+    // keys are "<prefix><number>" (processes of one test use different prefixes)
+    std::string key_prefix;
+
+    test_opts_t()
+        : count(0), iterations(1), warmup_ops(0), warmup_s(0), max_cv_pct(10.0), key_prefix("key") {}
+};
+
+// results of all iterations (means), indexed by op_e
+struct test_result_t {
+    double rate[3];         // op/s
+    double p50_us[3];
+    double p99_us[3];
+    int    errors;
+};
+
+// TEST operation: PUT, GET and DELETE phases over 'count' keys.
+//  Phases are repeated for several iterations, optional warm-up
+//  goes before them and is excluded from results.
+class test_workload_t {
+public:
+    test_workload_t(executor_t& executor, test_opts_t const& opts);
+    ~test_workload_t();
+
+    // runs warm-up (does nothing if it is not configured)
+    void warmup();
+
+    // runs all iterations and prints statistical summary,
+    //  returns number of errors (GET returned wrong value)
+    int run();
+
+    // results of run()
+    test_result_t result() const;
+
+private:
+    struct impl_t;
+    impl_t *m_impl;
+};
+
+#endif //WORKLOAD_HPP